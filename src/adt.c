@@ -976,13 +976,17 @@ void setup(void)
 void statistics(void)
 {
     XmString text;
-    double sum,sumsq,max,val,avg,sdev,dn;
+    double max,avg,sdev;
     double sdevval,avgval,maxval;
-    int i,ia,statusval,nvals;
+    int i,ia,statusval,nvals,nwords;
     int thresholdval;
-    double *vals=NULL,*savevals=NULL;
+    double *savevals=NULL;
     unsigned short *statusvals=NULL;
     unsigned short *thresholdvals=NULL;
+    static uint64_t *usemask=NULL;
+    static int nusemask=0;
+    int masked=checkstatus || checkthreshold;
+    AdtStats st;
     
     if(!ecainitialized) return;
   /* Check if arrays are defined */
@@ -991,44 +995,49 @@ void statistics(void)
     nstat+=1.;
     nstattime+=(double)timeinterval;
     for(ia=0; ia < narrays; ia++) {
-	dn=sum=sumsq=max=0.;
-	vals=arrays[ia].vals;
+	savevals=NULL;
 	if(whichorbit >= 0) savevals=arrays[ia].savevals[whichorbit];;
 	statusvals=arrays[ia].statusvals;
 	thresholdvals=arrays[ia].thresholdvals;
 	nvals=arrays[ia].nvals;
-	for(i=0; i < nvals; i++) {
-	    if(checkstatus) {
-		statusval=statusvals[i];
-		if(statusval == NOTCONN) continue;
-		if(checkstatusmode && statusval != UNUSED) {
-		    if(statusval == 0) continue;
-		    if(checkstatusmode == 2 && statusval == 2) continue;
+      /* Mask of the elements that pass the status and threshold checks */
+	if(masked) {
+	    nwords=(nvals+63)/64;
+	    if(nwords > nusemask) {
+		free(usemask);
+		usemask=(uint64_t *)calloc(nwords,sizeof(uint64_t));
+		if(usemask == NULL) {
+		    nusemask=0;
+		    xerrmsg("Could not allocate space for statistics");
+		    return;
 		}
+		nusemask=nwords;
 	    }
-	    if(checkthreshold) {
-		thresholdval=thresholdvals[i];
-		if(thresholdval == NOTCONN) continue;
-		if(checkthresholdmode && thresholdval != UNUSED) {
-		    if(thresholdval < 0) continue;
-		    if(checkthresholdmode == 2 && thresholdval == 2) continue;
+	    memset(usemask,0,nwords*sizeof(uint64_t));
+	    for(i=0; i < nvals; i++) {
+		if(checkstatus) {
+		    statusval=statusvals[i];
+		    if(statusval == NOTCONN) continue;
+		    if(checkstatusmode && statusval != UNUSED) {
+			if(statusval == 0) continue;
+			if(checkstatusmode == 2 && statusval == 2) continue;
+		    }
 		}
+		if(checkthreshold) {
+		    thresholdval=thresholdvals[i];
+		    if(thresholdval == NOTCONN) continue;
+		    if(checkthresholdmode && thresholdval != UNUSED) {
+			if(thresholdval < 0) continue;
+			if(checkthresholdmode == 2 && thresholdval == 2) continue;
+		    }
+		}
+		usemask[i>>6]|=(uint64_t)1<<(i&63);
 	    }
-	    if(whichorbit < 0) val=vals[i];
-	    else val=vals[i]-savevals[i];
-	    dn+=1.;
-	    sum+=val;
-	    sumsq+=(val*val);
-	    if(fabs(val) > fabs(max)) max=val;
-	}
-	if(dn) {
-	    avg=sum/dn;
-	    sdev=sqrt(sumsq/dn-avg*avg);
-	}
-	else {
-	    avg=0.;
-	    sdev=0.;
 	}
+	adtStatsCompute(&st,arrays[ia].vals,savevals,masked?usemask:NULL,nvals,
+	  NULL,NULL);
+	adtStatsMoments(&st,&avg,&sdev);
+	max=st.max;
       /* Convert to log10 if logscale is set */
 	if(arrays[ia].logscale) {
 	    sdev=sdev > 0.?log10(sdev):0.;
@@ -9,6 +9,7 @@
 /* adt.h *** Header file for ADT */
 
 #include "adtVersion.h"
+#include "adtStats.h"
 
 #include <stdio.h>
 #include <stdlib.h>
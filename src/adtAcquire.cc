@@ -0,0 +1,2023 @@
+/**
+ * @file adtAcquire.cc
+ * @brief Channel Access acquisition engine for the Qt front end.
+ *
+ * @copyright
+ * Copyright (c) 2002 The University of Chicago, as Operator of Argonne National Laboratory.
+ * Copyright (c) 2002 The Regents of the University of California, as Operator of Los Alamos National Laboratory.
+ * Distributed subject to a Software License Agreement found in the file LICENSE that is included with this distribution.
+ */
+
+#include "adtAcquire.h"
+#include "adtStats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+
+#include <cadef.h>
+#include <pv/pvaClient.h>
+#include <pv/pvaClientMultiChannel.h>
+
+/* Seqlock read attempts before falling back to the writer mutex */
+#define ACQ_READ_RETRIES 8
+/* Period at which polled sources (pvAccess, simulation) are serviced, ms */
+#define ACQ_SOURCE_POLL_MS 20
+/* Time the pvAccess connect thread waits on the first channel, s */
+#define ACQ_PVA_CONNECT_TIMEOUT 0.5
+/* Time an unreferenced CA channel stays cached, unsubscribed, after a
+   reload, s */
+#define ACQ_CACHE_LINGER 60
+/* Period at which lingering channels are checked, ms */
+#define ACQ_CACHE_SWEEP_MS 1000
+/* CA priority of channels for arrays on screen; hidden ones use the default */
+#define ACQ_CA_PRIORITY_SHOWN 20
+/* Default channels searched per batch, and the pause between batches, ms */
+#define ACQ_SEARCH_BATCH 200
+#define ACQ_SEARCH_INTERVAL_MS 100
+/* Time a restore put may take to connect, and then to complete, s */
+#define ACQ_RESTORE_TIMEOUT 10
+/* Period at which a running restore is advanced, ms */
+#define ACQ_RESTORE_POLL_MS 20
+/* Period at which per-IOC health is gathered, ms */
+#define ACQ_HEALTH_MS 1000
+/* POSIX time of the EPICS epoch, 1990-01-01 */
+#define ACQ_EPICS_EPOCH 631152000.0
+/* Simulated channels: updates per second, noise and drift amplitude,
+   drift period, s, amplitude and period, s, of the page-wide orbit wave
+   and its oscillations across the page, fraction of updates lost,
+   chance per second that a channel drops, and how long it stays down, s */
+#define ACQ_SIM_RATE 10.0
+#define ACQ_SIM_NOISE 0.02
+#define ACQ_SIM_DRIFT 0.2
+#define ACQ_SIM_DRIFT_PERIOD 300.0
+#define ACQ_SIM_ORBIT 0.5
+#define ACQ_SIM_ORBIT_PERIOD 60.0
+#define ACQ_SIM_TUNE 9.2
+#define ACQ_SIM_DROPOUT 0.01
+#define ACQ_SIM_DISCONNECT 1e-4
+#define ACQ_SIM_DOWNTIME 5.0
+
+static const char *PVA_PREFIX = "pva://";
+static const char *CA_PREFIX = "ca://";
+static const char *SIM_PREFIX = "sim://";
+/* M_PI is not defined by MSVC without _USE_MATH_DEFINES */
+static const double ACQ_TWO_PI = 6.283185307179586;
+
+enum AcqProtocol { ACQ_CA, ACQ_PVA, ACQ_SIM };
+
+using epics::pvaClient::PvaClient;
+using epics::pvaClient::PvaClientChannelPtr;
+using epics::pvaClient::PvaClientMonitorPtr;
+using epics::pvaClient::PvaClientMultiChannel;
+using epics::pvaClient::PvaClientMultiChannelPtr;
+using epics::pvaClient::PvaClientMultiMonitorDoublePtr;
+namespace pvd = epics::pvData;
+
+/**
+ * @brief One buffer element (or whole array, for a waveform) fed by a channel.
+ */
+struct AcqTarget
+{
+  enum Kind { Value, Status, Threshold };
+  std::shared_ptr<AcqBuffer> buf;
+  int index = 0;
+  std::vector<int> map;
+  Kind kind = Value;
+  double lower = 0.0;
+  double upper = 0.0;
+};
+
+/**
+ * @brief A cached CA channel.
+ *
+ * There is one channel and one subscription per unique PV name, fanned
+ * out to every array element that lists it. Channels are kept across PV
+ * file loads; when a new file uses the same PV the channel is pointed at
+ * the new buffers and seeds them with the last value, so nothing is
+ * searched for again. An unreferenced channel keeps only its connection
+ * while it lingers; its subscription is cleared and made again if a later
+ * file claims it. The targets and the last value are shared with the
+ * CA callback threads under @c lock.
+ */
+struct AcqChannel
+{
+  chid ch = nullptr;
+  evid ev = nullptr;
+  bool waveform = false;
+  /* Acquisition thread only */
+  bool claimed = false;
+  bool lingering = false;
+  bool queued = false;
+  int priority = 0;
+  /* CA priority the channel was created at */
+  int caPriority = 0;
+  /* (array, interval) for each array that lists the channel */
+  std::vector<std::pair<int, int>> uses;
+  /* ms between gets, or 0 to subscribe; paused if no array is shown */
+  int interval = 0;
+  bool paused = false;
+  std::chrono::steady_clock::time_point nextGet;
+  std::chrono::steady_clock::time_point releaseAt;
+  /* DBR type of the subscription */
+  long evType = -1;
+  AcqEngine *engine = nullptr;
+  /* Server the channel last connected to, and the counts last gathered */
+  std::string host;
+  unsigned long updatesSeen = 0;
+  double latencySeen = 0.0;
+  /* When a heartbeat get was last sent, POSIX s */
+  double heartbeatSent = 0.0;
+
+  std::vector<AcqTarget> pending;
+
+  std::mutex lock;
+  std::vector<AcqTarget> targets;
+  bool up = false;
+  bool haveValue = false;
+  std::vector<double> last;
+  double lastStamp = 0.0;
+  int lastSeverity = 0;
+  /* Updates and connections since the channel was created; arrival is POSIX s */
+  unsigned long updates = 0;
+  double latencySum = 0.0;
+  double lastArrival = 0.0;
+  bool everUp = false;
+  unsigned reconnects = 0;
+
+  void setTargets(std::vector<AcqTarget> &t);
+  void push();
+  void pushValidity(const AcqTarget &t);
+  void notifyUp(chid id)
+  {
+    if (engine)
+      engine->channelUp(ca_name(id), waveform);
+  }
+};
+
+/**
+ * @brief Channels of one array that are polled from the acquisition
+ * thread rather than called back, while the array is shown, and no more
+ * often than the array's interval if it has one.
+ */
+struct AcqSource
+{
+  int array = 0;
+  std::shared_ptr<AcqBuffer> buf;
+  int interval = 0;
+  std::chrono::steady_clock::time_point nextPoll;
+
+  virtual ~AcqSource() {}
+  virtual void poll() = 0;
+};
+
+/**
+ * @brief pvAccess channels for one array.
+ *
+ * pvaClient monitors are queued rather than called back, so these are
+ * polled from the acquisition thread. Scalar rows share one multi-channel
+ * monitor; a waveform page is one NTScalarArray monitor.
+ */
+struct AcqPvaSource : AcqSource
+{
+  /* scalar rows: buffer element of each channel */
+  std::vector<int> index;
+  /* scalar rows: channel has had a monitor event since it connected */
+  std::vector<char> live;
+  /* scalar rows: connection of each channel as last seen, and whether any is up */
+  std::vector<char> up;
+  bool anyUp = false;
+  PvaClientMultiChannelPtr multi;
+  /* set by the connect thread once multi may be used */
+  std::shared_ptr<std::atomic<bool>> ready;
+  PvaClientMultiMonitorDoublePtr multiMonitor;
+  /* waveform page */
+  std::vector<int> map;
+  PvaClientChannelPtr channel;
+  PvaClientMonitorPtr monitor;
+  bool reported = false;
+
+  void poll() override;
+  void pollScalars();
+  void pollWaveform();
+};
+
+/**
+ * @brief Simulated channels for one array, generated in process.
+ *
+ * Each channel sits at an offset derived from its name and carries
+ * noise, a slow drift and a betatron-like wave shared by the page.
+ * Scalar rows update round-robin at the configured rate, lose a few
+ * updates and now and then drop for a while, like channels of a busy
+ * IOC; a waveform page updates as a whole. Nothing touches the network,
+ * so any PV file can be run offline at any size.
+ */
+struct AcqSimSource : AcqSource
+{
+  /* buffer element of each channel */
+  std::vector<int> index;
+  bool waveform = false;
+  std::vector<double> base;
+  std::vector<double> phase;
+  std::vector<double> downUntil;
+  double rate = ACQ_SIM_RATE;
+  double started = -1.0;
+  double last = 0.0;
+  double due = 0.0;
+  size_t cursor = 0;
+  std::mt19937 rng;
+  std::normal_distribution<double> noise{0.0, ACQ_SIM_NOISE};
+  std::uniform_real_distribution<double> uniform{0.0, 1.0};
+
+  AcqSimSource(const std::vector<std::string> &names, const std::vector<int> &index);
+  void poll() override;
+  double value(size_t k, double t);
+};
+
+/**************************** AcqBuffer *******************************/
+
+/* Local receive time, POSIX s, also the stamp of values that carry none */
+static double acqNow()
+{
+  return std::chrono::duration<double>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+#define ACQ_WORD(i) ((i) >> 6)
+#define ACQ_BIT(i) ((uint64_t)1 << ((i) & 63))
+
+AcqBuffer::AcqBuffer(int n)
+  : nvals(n), nwords((n + 63) / 64), seq(0), nconn(0), ndrops(0), vals(n), stamps(n),
+    arrivals(n), severity(n), validity(n), connBits(nwords), changedBits(nwords),
+    readMask(nwords, 0)
+{
+  for (int i = 0; i < n; i++) {
+    vals[i].store(0.0, std::memory_order_relaxed);
+    stamps[i].store(0.0, std::memory_order_relaxed);
+    arrivals[i].store(0.0, std::memory_order_relaxed);
+    severity[i].store(0, std::memory_order_relaxed);
+    validity[i].store(0, std::memory_order_relaxed);
+  }
+  for (int w = 0; w < nwords; w++) {
+    connBits[w].store(0, std::memory_order_relaxed);
+    changedBits[w].store(~(uint64_t)0, std::memory_order_relaxed);
+  }
+}
+
+void AcqBuffer::beginWrite()
+{
+  seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+void AcqBuffer::endWrite()
+{
+  seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+bool AcqBuffer::isConnected(int i) const
+{
+  return connBits[ACQ_WORD(i)].load(std::memory_order_relaxed) & ACQ_BIT(i);
+}
+
+/**
+ * @brief Set one connection bit and keep the running count. Called
+ * inside a write.
+ */
+void AcqBuffer::setConnBit(int i, bool up)
+{
+  uint64_t word = connBits[ACQ_WORD(i)].load(std::memory_order_relaxed);
+  if (((word & ACQ_BIT(i)) != 0) == up)
+    return;
+  connBits[ACQ_WORD(i)].store(up ? word | ACQ_BIT(i) : word & ~ACQ_BIT(i),
+                              std::memory_order_relaxed);
+  nconn.fetch_add(up ? 1 : -1, std::memory_order_relaxed);
+  if (!up)
+    ndrops.fetch_add(1, std::memory_order_relaxed);
+}
+
+void AcqBuffer::markChanged(int i)
+{
+  changedBits[ACQ_WORD(i)].fetch_or(ACQ_BIT(i), std::memory_order_relaxed);
+}
+
+void AcqBuffer::markAllChanged()
+{
+  for (int w = 0; w < nwords; w++)
+    changedBits[w].store(~(uint64_t)0, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Store a new value for one element. A value implies a connection.
+ */
+void AcqBuffer::store(int index, double value, double stamp, int sevr, double arrival)
+{
+  if (index < 0 || index >= nvals)
+    return;
+  std::lock_guard<std::mutex> lock(writeLock);
+  beginWrite();
+  vals[index].store(value, std::memory_order_relaxed);
+  stamps[index].store(stamp, std::memory_order_relaxed);
+  arrivals[index].store(arrival, std::memory_order_relaxed);
+  severity[index].store((unsigned char)sevr, std::memory_order_relaxed);
+  setConnBit(index, true);
+  markChanged(index);
+  endWrite();
+}
+
+/**
+ * @brief Update the connection state of one element.
+ *
+ * A disconnected element reads as zero, as in the Motif version.
+ */
+void AcqBuffer::setConnected(int index, bool up)
+{
+  if (index < 0 || index >= nvals)
+    return;
+  std::lock_guard<std::mutex> lock(writeLock);
+  if (isConnected(index) == up)
+    return;
+  beginWrite();
+  setConnBit(index, up);
+  if (!up)
+    vals[index].store(0.0, std::memory_order_relaxed);
+  markChanged(index);
+  endWrite();
+}
+
+/**
+ * @brief Store a whole array from one waveform update.
+ *
+ * All elements change under a single sequence bump, so a reader sees
+ * either the previous waveform or this one. Elements the map points past
+ * the end of the waveform read as disconnected.
+ */
+void AcqBuffer::storeWaveform(const double *src, long count,
+                              const std::vector<int> &map,
+                              double stamp, int sevr, double arrival)
+{
+  std::lock_guard<std::mutex> lock(writeLock);
+  beginWrite();
+  for (int i = 0; i < nvals; i++) {
+    long j = map.empty() ? i : (i < (int)map.size() ? map[i] : -1);
+    bool up = (j >= 0 && j < count);
+    vals[i].store(up ? src[j] : 0.0, std::memory_order_relaxed);
+    stamps[i].store(stamp, std::memory_order_relaxed);
+    arrivals[i].store(arrival, std::memory_order_relaxed);
+    severity[i].store((unsigned char)sevr, std::memory_order_relaxed);
+    setConnBit(i, up);
+  }
+  markAllChanged();
+  endWrite();
+}
+
+void AcqBuffer::setAllConnected(bool up)
+{
+  std::lock_guard<std::mutex> lock(writeLock);
+  if (up || nconn.load(std::memory_order_relaxed) == 0)
+    return;
+  beginWrite();
+  for (int i = 0; i < nvals; i++)
+    vals[i].store(0.0, std::memory_order_relaxed);
+  for (int w = 0; w < nwords; w++)
+    connBits[w].store(0, std::memory_order_relaxed);
+  ndrops.fetch_add(nconn.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  nconn.store(0, std::memory_order_relaxed);
+  markAllChanged();
+  endWrite();
+}
+
+/**
+ * @brief Replace the validity flags one channel contributes to an
+ * element: the status flags for a @p shift of 0, the threshold flags for
+ * ACQ_THRESHOLD_SHIFT.
+ */
+void AcqBuffer::storeValidity(int index, int shift, unsigned char flags)
+{
+  if (index < 0 || index >= nvals)
+    return;
+  std::lock_guard<std::mutex> lock(writeLock);
+  unsigned char old = validity[index].load(std::memory_order_relaxed);
+  unsigned char v = (unsigned char)((old & ~(0x0f << shift)) | (flags << shift));
+  if (v == old)
+    return;
+  beginWrite();
+  validity[index].store(v, std::memory_order_relaxed);
+  markChanged(index);
+  endWrite();
+}
+
+/**
+ * @brief Store values for a set of elements under one sequence bump.
+ * Their sources carry no time stamp, so @p stamp is the receipt time.
+ */
+void AcqBuffer::storeBatch(const std::vector<int> &index,
+                           const std::vector<double> &values,
+                           const std::vector<char> &up, double stamp)
+{
+  std::lock_guard<std::mutex> lock(writeLock);
+  beginWrite();
+  for (size_t k = 0; k < index.size(); k++) {
+    int i = index[k];
+    if (i < 0 || i >= nvals)
+      continue;
+    setConnBit(i, up[k]);
+    vals[i].store(up[k] ? values[k] : 0.0, std::memory_order_relaxed);
+    if (up[k]) {
+      stamps[i].store(stamp, std::memory_order_relaxed);
+      arrivals[i].store(stamp, std::memory_order_relaxed);
+    }
+    markChanged(i);
+  }
+  endWrite();
+}
+
+/**
+ * @brief Move the changed bits into the reader's mask.
+ */
+void AcqBuffer::takeChanged() const
+{
+  for (int w = 0; w < nwords; w++) {
+    if (changedBits[w].load(std::memory_order_relaxed))
+      readMask[w] |= changedBits[w].exchange(0, std::memory_order_relaxed);
+  }
+}
+
+/**
+ * @brief Copy the elements in the reader's mask.
+ */
+void AcqBuffer::copyOut(const AcqFrame &out) const
+{
+  for (int w = 0; w < nwords; w++) {
+    uint64_t mask = readMask[w];
+    if (!mask)
+      continue;
+    if (out.changed)
+      out.changed[w] |= w == nwords - 1 && nvals % 64 ? mask & ((uint64_t(1) << nvals % 64) - 1) : mask;
+    uint64_t cbits = connBits[w].load(std::memory_order_relaxed);
+    while (mask) {
+      int b = adtCountTrailingZeros(mask);
+      mask &= mask - 1;
+      int i = w * 64 + b;
+      if (i >= nvals)
+        break;
+      out.vals[i] = vals[i].load(std::memory_order_relaxed);
+      out.conn[i] = (cbits >> b) & 1;
+      if (out.stamps)
+        out.stamps[i] = stamps[i].load(std::memory_order_relaxed);
+      if (out.arrivals)
+        out.arrivals[i] = arrivals[i].load(std::memory_order_relaxed);
+      if (out.severity)
+        out.severity[i] = severity[i].load(std::memory_order_relaxed);
+      if (out.validity)
+        out.validity[i] = validity[i].load(std::memory_order_relaxed);
+    }
+  }
+}
+
+/**
+ * @brief Bring @p out up to date if the buffer changed since @p seen.
+ *
+ * Only elements written since the last read are copied, so @p out must
+ * still hold the previous frame and the cost follows the number of
+ * updates and connection changes rather than the array size. Readers
+ * never block writers; if writers keep the buffer busy the copy is taken
+ * under the writer mutex instead of spinning.
+ */
+bool AcqBuffer::read(const AcqFrame &out, uint64_t &seen) const
+{
+  for (int attempt = 0; attempt < ACQ_READ_RETRIES; attempt++) {
+    uint64_t s1 = seq.load(std::memory_order_acquire);
+    if (s1 == seen)
+      return false;
+    if (s1 & 1) {
+      std::this_thread::yield();
+      continue;
+    }
+    takeChanged();
+    copyOut(out);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (seq.load(std::memory_order_relaxed) == s1) {
+      std::fill(readMask.begin(), readMask.end(), 0);
+      seen = s1;
+      return true;
+    }
+  }
+  std::lock_guard<std::mutex> lock(writeLock);
+  uint64_t s = seq.load(std::memory_order_relaxed);
+  if (s == seen)
+    return false;
+  takeChanged();
+  copyOut(out);
+  std::fill(readMask.begin(), readMask.end(), 0);
+  seen = s;
+  return true;
+}
+
+/**
+ * @brief Copy the channel state into all its targets. Called with
+ * @c lock held.
+ *
+ * A channel that has connected but not yet delivered a value is still
+ * shown as disconnected, so after an IOC reboot the zero left by the
+ * disconnect never reaches the min/max or the statistics.
+ */
+void AcqChannel::push()
+{
+  for (AcqTarget &t : targets) {
+    if (t.kind != AcqTarget::Value) {
+      pushValidity(t);
+      continue;
+    }
+    if (waveform) {
+      if (!up)
+        t.buf->setAllConnected(false);
+      else if (haveValue)
+        t.buf->storeWaveform(last.data(), (long)last.size(), t.map,
+                             lastStamp, lastSeverity, lastArrival);
+    } else {
+      if (up && haveValue)
+        t.buf->store(t.index, last[0], lastStamp, lastSeverity, lastArrival);
+      else
+        t.buf->setConnected(t.index, false);
+    }
+  }
+}
+
+/**
+ * @brief Turn the value of a status or threshold channel into validity
+ * flags for its element. Status values are 0 InValid, 1 Valid and
+ * 2 OldData; a threshold value is valid inside its limits.
+ */
+void AcqChannel::pushValidity(const AcqTarget &t)
+{
+  unsigned char flags;
+  if (!up || !haveValue)
+    flags = ACQ_NOTCONN;
+  else if (t.kind == AcqTarget::Status)
+    flags = last[0] == 0.0 ? ACQ_INVALID : last[0] == 2.0 ? ACQ_OLDDATA : 0;
+  else
+    flags = last[0] >= t.lower && last[0] <= t.upper ? 0 : ACQ_INVALID;
+  t.buf->storeValidity(t.index, t.kind == AcqTarget::Status ? 0 : ACQ_THRESHOLD_SHIFT,
+                       flags);
+}
+
+/**
+ * @brief Replace the targets (an empty list detaches the channel).
+ * @p t is left empty.
+ */
+void AcqChannel::setTargets(std::vector<AcqTarget> &t)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  targets.swap(t);
+  t.clear();
+  push();
+}
+
+/**
+ * @brief Record a connection change; a new connection also asks the
+ * acquisition thread to subscribe in the channel's native type.
+ */
+static void acqConnectHandler(struct connection_handler_args args)
+{
+  AcqChannel *c = static_cast<AcqChannel *>(ca_puser(args.chid));
+  if (!c)
+    return;
+  {
+    std::lock_guard<std::mutex> guard(c->lock);
+    c->up = (args.op == CA_OP_CONN_UP);
+    if (!c->up)
+      c->haveValue = false;
+    else if (c->everUp)
+      c->reconnects++;
+    c->everUp = c->everUp || c->up;
+    c->push();
+  }
+  if (args.op == CA_OP_CONN_UP)
+    c->notifyUp(args.chid);
+}
+
+/**
+ * @brief DBR_TIME type to read a channel in, or -1 while it is not
+ * connected.
+ *
+ * Numeric fields travel in their native type, which for the 16-bit and
+ * 8-bit status and ADC records is a fraction of a double, and are widened
+ * when they arrive. Strings are still converted by the server.
+ */
+static long acqNativeType(chid ch)
+{
+  if (!ch || ca_state(ch) != cs_conn)
+    return -1;
+  short type = ca_field_type(ch);
+  switch (type) {
+  case DBF_SHORT:
+  case DBF_FLOAT:
+  case DBF_ENUM:
+  case DBF_CHAR:
+  case DBF_LONG:
+    return dbf_type_to_DBR_TIME(type);
+  default:
+    return DBR_TIME_DOUBLE;
+  }
+}
+
+/**
+ * @brief Widen a DBR_TIME value of type @p T to doubles in @p c.
+ */
+template <typename T>
+static void acqWiden(AcqChannel *c, const void *dbr, long count)
+{
+  const T *tv = (const T *)dbr;
+  const auto *v = &tv->value;
+  c->last.assign(v, v + count);
+  c->lastStamp = tv->stamp.secPastEpoch + ACQ_EPICS_EPOCH + tv->stamp.nsec * 1e-9;
+  c->lastSeverity = tv->severity;
+}
+
+/**
+ * @brief Take in a monitor event or get reply. A heartbeat reply only
+ * renews the arrival time: it is not counted as an update, and a failed
+ * one is left to the connection handler.
+ */
+static void acqReceive(struct event_handler_args args, bool heartbeat)
+{
+  AcqChannel *c = static_cast<AcqChannel *>(args.usr);
+  if (!c)
+    return;
+  std::lock_guard<std::mutex> guard(c->lock);
+  if (args.status != ECA_NORMAL || !args.dbr) {
+    if (heartbeat)
+      return;
+    c->up = false;
+    c->haveValue = false;
+    c->push();
+    return;
+  }
+  long count = c->waveform ? args.count : 1;
+  switch (args.type) {
+  case DBR_TIME_SHORT:
+    acqWiden<struct dbr_time_short>(c, args.dbr, count);
+    break;
+  case DBR_TIME_FLOAT:
+    acqWiden<struct dbr_time_float>(c, args.dbr, count);
+    break;
+  case DBR_TIME_ENUM:
+    acqWiden<struct dbr_time_enum>(c, args.dbr, count);
+    break;
+  case DBR_TIME_CHAR:
+    acqWiden<struct dbr_time_char>(c, args.dbr, count);
+    break;
+  case DBR_TIME_LONG:
+    acqWiden<struct dbr_time_long>(c, args.dbr, count);
+    break;
+  default:
+    acqWiden<struct dbr_time_double>(c, args.dbr, count);
+    break;
+  }
+  c->lastArrival = acqNow();
+  if (!heartbeat) {
+    c->latencySum += c->lastArrival - c->lastStamp;
+    c->updates++;
+  }
+  c->up = true;
+  c->haveValue = true;
+  c->push();
+}
+
+static void acqEventHandler(struct event_handler_args args)
+{
+  acqReceive(args, false);
+}
+
+static void acqHeartbeatHandler(struct event_handler_args args)
+{
+  acqReceive(args, true);
+}
+
+/**
+ * @brief One PV written by a restore.
+ *
+ * Owned by the acquisition thread; the CA callbacks only set the atomics.
+ * Restores use channels of their own, so clearing them guarantees no
+ * callback outlives the job.
+ */
+struct AcqPutOp
+{
+  enum State { Pending, Searching, Issued, Done, Failed };
+  std::string name;
+  double value = 0.0;
+  chid ch = nullptr;
+  State state = Pending;
+  std::string error;
+  std::chrono::steady_clock::time_point since;
+  std::atomic<bool> up{false};
+  std::atomic<int> status{-1};
+};
+
+struct AcqRestoreJob
+{
+  std::vector<std::unique_ptr<AcqPutOp>> ops;
+  /* First op not yet searched for */
+  size_t next = 0;
+  /* Puts issued and not yet complete */
+  int outstanding = 0;
+  std::chrono::steady_clock::time_point start;
+  std::chrono::steady_clock::time_point nextBatch;
+};
+
+static void acqPutConnectHandler(struct connection_handler_args args)
+{
+  AcqPutOp *op = static_cast<AcqPutOp *>(ca_puser(args.chid));
+  if (op)
+    op->up.store(args.op == CA_OP_CONN_UP, std::memory_order_release);
+}
+
+static void acqPutHandler(struct event_handler_args args)
+{
+  AcqPutOp *op = static_cast<AcqPutOp *>(args.usr);
+  if (op)
+    op->status.store(args.status, std::memory_order_release);
+}
+
+/**************************** pvAccess *******************************/
+
+void AcqPvaSource::poll()
+{
+  try {
+    if (multi)
+      pollScalars();
+    if (channel)
+      pollWaveform();
+  } catch (std::exception &e) {
+    if (!reported)
+      fprintf(stderr, "pvAccess: %s\n", e.what());
+    reported = true;
+  }
+}
+
+/**
+ * @brief Fold in multi-channel monitor events and connection changes.
+ *
+ * The monitor only covers channels connected when it was made, so it is
+ * recreated whenever the connection set changes.
+ */
+void AcqPvaSource::pollScalars()
+{
+  if (!ready->load(std::memory_order_acquire))
+    return;
+  bool changed = up.empty() || multi->connectionChange();
+  if (changed) {
+    pvd::shared_vector<pvd::boolean> isConnected = multi->getIsConnected();
+    up.assign(index.size(), 0);
+    anyUp = false;
+    for (size_t k = 0; k < index.size(); k++) {
+      up[k] = k < isConnected.size() && isConnected[k];
+      anyUp = anyUp || up[k];
+    }
+    live.resize(index.size(), 0);
+  }
+  if (!anyUp) {
+    if (changed) {
+      multiMonitor.reset();
+      live.assign(index.size(), 0);
+      buf->storeBatch(index, std::vector<double>(index.size(), 0.0), up, 0.0);
+    }
+    return;
+  }
+  if (changed || !multiMonitor)
+    multiMonitor = multi->createMonitor();
+  bool event = multiMonitor->poll();
+  if (!changed && !event)
+    return;
+  if (!event) {
+    /* Channels that just came back wait for the monitor's first event */
+    for (size_t k = 0; k < index.size(); k++) {
+      live[k] = live[k] && up[k];
+      if (!live[k])
+        buf->setConnected(index[k], false);
+    }
+    return;
+  }
+  pvd::shared_vector<double> data = multiMonitor->get();
+  std::vector<double> values(index.size(), 0.0);
+  for (size_t k = 0; k < index.size(); k++) {
+    live[k] = up[k];
+    if (up[k] && k < data.size())
+      values[k] = data[k];
+  }
+  buf->storeBatch(index, values, up, acqNow());
+  reported = false;
+}
+
+void AcqPvaSource::pollWaveform()
+{
+  if (!channel->getChannel()->isConnected()) {
+    if (monitor) {
+      monitor.reset();
+      buf->setAllConnected(false);
+    }
+    return;
+  }
+  if (!monitor)
+    monitor = channel->monitor("value,alarm,timeStamp");
+  while (monitor->poll()) {
+    epics::pvaClient::PvaClientMonitorDataPtr data = monitor->getData();
+    pvd::shared_vector<const double> v = data->getDoubleArray();
+    pvd::TimeStamp ts = data->getTimeStamp();
+    pvd::Alarm alarm = data->getAlarm();
+    buf->storeWaveform(v.data(), (long)v.size(), map,
+                       ts.getSecondsPastEpoch() + ts.getNanoseconds() * 1e-9,
+                       alarm.getSeverity(), acqNow());
+    monitor->releaseEvent();
+  }
+}
+
+/**************************** Simulation *******************************/
+
+AcqSimSource::AcqSimSource(const std::vector<std::string> &names,
+                           const std::vector<int> &idx)
+  : index(idx), base(names.size()), phase(names.size()), downUntil(names.size(), 0.0)
+{
+  std::hash<std::string> hash;
+  for (size_t k = 0; k < names.size(); k++) {
+    size_t h = hash(names[k]);
+    base[k] = (double)(h % 2001) / 1000.0 - 1.0;
+    phase[k] = (double)((h / 2001) % 6283) / 1000.0;
+  }
+  rng.seed((unsigned)hash(names.empty() ? std::string() : names[0]));
+}
+
+double AcqSimSource::value(size_t k, double t)
+{
+  double n = (double)index.size();
+  double orbit = ACQ_SIM_ORBIT *
+    std::sin(ACQ_TWO_PI * (ACQ_SIM_TUNE * k / n + t / ACQ_SIM_ORBIT_PERIOD));
+  double drift = ACQ_SIM_DRIFT * std::sin(ACQ_TWO_PI * t / ACQ_SIM_DRIFT_PERIOD + phase[k]);
+  return base[k] + orbit + drift + noise(rng);
+}
+
+/**
+ * @brief Write the updates due since the last poll under one sequence
+ * bump.
+ *
+ * Everything comes up on the first poll, as if all channels connected
+ * at once; after that a share of rate x elapsed time of the rows is
+ * updated in turn.
+ */
+void AcqSimSource::poll()
+{
+  double now = acqNow();
+  if (index.empty())
+    return;
+  std::vector<int> idx;
+  std::vector<double> values;
+  std::vector<char> up;
+  size_t nupdate;
+  if (started < 0.0) {
+    started = now;
+    nupdate = index.size();
+  } else if (waveform) {
+    if (now < due)
+      return;
+    nupdate = index.size();
+  } else {
+    due += (now - last) * rate * index.size();
+    nupdate = (size_t)due;
+    due -= nupdate;
+    nupdate = std::min(nupdate, index.size());
+  }
+  last = now;
+  double t = now - started;
+  if (waveform) {
+    /* The whole waveform drops, or skips an update, at once */
+    due = now + 1.0 / rate;
+    double u = uniform(rng);
+    bool drop = now < downUntil[0] || u < ACQ_SIM_DISCONNECT / rate;
+    if (!drop && u < ACQ_SIM_DISCONNECT / rate + ACQ_SIM_DROPOUT && t > 0.0)
+      return;
+    if (drop && now >= downUntil[0])
+      downUntil[0] = now + ACQ_SIM_DOWNTIME;
+    for (size_t k = 0; k < index.size(); k++)
+      values.push_back(drop ? 0.0 : value(k, t));
+    up.assign(index.size(), drop ? 0 : 1);
+    buf->storeBatch(index, values, up, now);
+    return;
+  }
+  for (size_t n = 0; n < nupdate; n++) {
+    size_t k = cursor;
+    cursor = (cursor + 1) % index.size();
+    if (now < downUntil[k])
+      continue;
+    double u = uniform(rng);
+    if (u < ACQ_SIM_DISCONNECT / rate) {
+      downUntil[k] = now + ACQ_SIM_DOWNTIME;
+      idx.push_back(index[k]);
+      values.push_back(0.0);
+      up.push_back(0);
+      continue;
+    }
+    if (u < ACQ_SIM_DISCONNECT / rate + ACQ_SIM_DROPOUT && t > 0.0)
+      continue;
+    idx.push_back(index[k]);
+    values.push_back(value(k, t));
+    up.push_back(1);
+  }
+  if (!idx.empty())
+    buf->storeBatch(idx, values, up, now);
+}
+
+/**
+ * @brief Strip a protocol prefix from a name and return its protocol,
+ * @p def when it has none.
+ */
+static AcqProtocol splitProtocol(const std::string &name, AcqProtocol def, std::string &bare)
+{
+  size_t npva = strlen(PVA_PREFIX), nca = strlen(CA_PREFIX), nsim = strlen(SIM_PREFIX);
+  if (name.compare(0, npva, PVA_PREFIX) == 0) {
+    bare = name.substr(npva);
+    return ACQ_PVA;
+  }
+  if (name.compare(0, nca, CA_PREFIX) == 0) {
+    bare = name.substr(nca);
+    return ACQ_CA;
+  }
+  if (name.compare(0, nsim, SIM_PREFIX) == 0) {
+    bare = name.substr(nsim);
+    return ACQ_SIM;
+  }
+  bare = name;
+  return def;
+}
+
+static AcqProtocol specProtocol(const AcqArraySpec &spec)
+{
+  return spec.sim ? ACQ_SIM : spec.pva ? ACQ_PVA : ACQ_CA;
+}
+
+/**************************** AcqEngine *******************************/
+
+AcqEngine::AcqEngine()
+  : searchBatch(ACQ_SEARCH_BATCH), searchInterval(ACQ_SEARCH_INTERVAL_MS),
+    searchPending(0), simRate(ACQ_SIM_RATE), heartbeat(0.0)
+{
+}
+
+AcqEngine::~AcqEngine()
+{
+  stop();
+}
+
+/**
+ * @brief Start the acquisition thread and create its CA context.
+ *
+ * Returns false if the context could not be created.
+ */
+bool AcqEngine::start()
+{
+  if (running())
+    return true;
+  {
+    std::lock_guard<std::mutex> lock(cmdLock);
+    startDone = false;
+    startOk = false;
+  }
+  thread = std::thread(&AcqEngine::run, this);
+  std::unique_lock<std::mutex> lock(cmdLock);
+  cmdReady.wait(lock, [this]() { return startDone; });
+  if (!startOk) {
+    lock.unlock();
+    thread.join();
+    return false;
+  }
+  return true;
+}
+
+void AcqEngine::stop()
+{
+  if (!running())
+    return;
+  Command cmd;
+  cmd.kind = Command::Quit;
+  post(cmd);
+  thread.join();
+  buffers.clear();
+}
+
+void AcqEngine::post(Command cmd)
+{
+  {
+    std::lock_guard<std::mutex> lock(cmdLock);
+    commands.push_back(std::move(cmd));
+  }
+  cmdReady.notify_all();
+}
+
+/**
+ * @brief Set how many channels are searched for at once and the pause
+ * between batches. Values below 1 keep the current setting.
+ */
+void AcqEngine::setSearchRate(int batch, int intervalMs)
+{
+  if (batch > 0)
+    searchBatch.store(batch, std::memory_order_relaxed);
+  if (intervalMs > 0)
+    searchInterval.store(intervalMs, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Set the updates per second of each simulated channel, for
+ * arrays loaded from now on. Values of 0 or less keep the current rate.
+ */
+void AcqEngine::setSimRate(double hz)
+{
+  if (hz > 0.0)
+    simRate.store(hz, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Read subscribed CA channels that have sent nothing for
+ * @p seconds, so a quiet PV still shows its IOC answering. 0 turns the
+ * heartbeat off. It is checked every ACQ_HEALTH_MS.
+ */
+void AcqEngine::setHeartbeat(double seconds)
+{
+  heartbeat.store(seconds > 0.0 ? seconds : 0.0, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Tell the engine which arrays are on screen.
+ *
+ * Channels used only by hidden arrays stop their subscriptions and gets;
+ * when an array is shown again its channels resubscribe, which brings the
+ * current values in one update.
+ */
+void AcqEngine::setVisible(const std::vector<bool> &visible)
+{
+  Command cmd;
+  cmd.kind = Command::Visibility;
+  cmd.visible = visible;
+  if (running())
+    post(cmd);
+}
+
+/**
+ * @brief Write values back to their PVs with ca_put_callback.
+ *
+ * Channels are searched for in paced batches like those of a PV file,
+ * and at most one batch of puts is outstanding at a time. Progress and
+ * the final report are read with restoreStatus(). Returns false if a
+ * restore is already running.
+ */
+bool AcqEngine::restore(const std::vector<AcqPut> &puts)
+{
+  if (!running())
+    return false;
+  {
+    std::lock_guard<std::mutex> lock(statusLock);
+    if (status.active)
+      return false;
+    status = AcqRestoreStatus();
+    status.active = true;
+    status.total = (int)puts.size();
+  }
+  Command cmd;
+  cmd.kind = Command::Restore;
+  cmd.puts = puts;
+  post(cmd);
+  return true;
+}
+
+AcqRestoreStatus AcqEngine::restoreStatus() const
+{
+  std::lock_guard<std::mutex> lock(statusLock);
+  return status;
+}
+
+/**
+ * @brief Replace the acquired arrays.
+ *
+ * The new back buffers are visible to read() immediately; channels are
+ * created on the acquisition thread and fill them in as they connect.
+ */
+void AcqEngine::load(const std::vector<AcqArraySpec> &specs)
+{
+  Command cmd;
+  cmd.kind = Command::Load;
+  cmd.specs = specs;
+  for (const AcqArraySpec &spec : specs)
+    cmd.buffers.push_back(std::make_shared<AcqBuffer>((int)spec.names.size()));
+  buffers = cmd.buffers;
+  if (running())
+    post(cmd);
+}
+
+bool AcqEngine::read(int iarray, const AcqFrame &out, uint64_t &seen) const
+{
+  if (iarray < 0 || iarray >= (int)buffers.size())
+    return false;
+  return buffers[iarray]->read(out, seen);
+}
+
+int AcqEngine::connected(int iarray) const
+{
+  if (iarray < 0 || iarray >= (int)buffers.size())
+    return 0;
+  return buffers[iarray]->connected();
+}
+
+/**
+ * @brief Count of elements of an array that have lost their connection
+ * since it was loaded. Called from the GUI thread.
+ */
+unsigned AcqEngine::drops(int iarray) const
+{
+  if (iarray < 0 || iarray >= (int)buffers.size())
+    return 0;
+  return buffers[iarray]->drops();
+}
+
+void AcqEngine::run()
+{
+  int status = ca_context_create(ca_enable_preemptive_callback);
+  {
+    std::lock_guard<std::mutex> lock(cmdLock);
+    startDone = true;
+    startOk = (status == ECA_NORMAL);
+  }
+  cmdReady.notify_all();
+  if (status != ECA_NORMAL)
+    return;
+
+  lastHealth = std::chrono::steady_clock::now();
+  std::vector<std::pair<std::string, bool>> ups;
+  for (;;) {
+    Command cmd;
+    {
+      std::unique_lock<std::mutex> lock(cmdLock);
+      auto ready = [this]() { return !commands.empty() || !upQueue.empty(); };
+      int wait = idleWait();
+      bool woken = true;
+      if (wait < 0)
+        cmdReady.wait(lock, ready);
+      else
+        woken = cmdReady.wait_for(lock, std::chrono::milliseconds(wait), ready);
+      ups.swap(upQueue);
+      if (!woken || commands.empty()) {
+        lock.unlock();
+        subscribeConnected(ups);
+        issueSearches();
+        issueGets();
+        advanceRestore();
+        pollSources();
+        sweepCache(false);
+        updateHealth();
+        continue;
+      }
+      cmd = std::move(commands.front());
+      commands.pop_front();
+    }
+    subscribeConnected(ups);
+    if (cmd.kind == Command::Quit)
+      break;
+    if (cmd.kind == Command::Visibility)
+      doVisibility(cmd);
+    else if (cmd.kind == Command::Restore)
+      doRestore(cmd);
+    else
+      doLoad(cmd);
+  }
+
+  if (restoreJob) {
+    for (std::unique_ptr<AcqPutOp> &op : restoreJob->ops) {
+      if (op->ch)
+        ca_clear_channel(op->ch);
+    }
+    restoreJob.reset();
+  }
+
+  sources.clear();
+  polled.clear();
+  searchQueue.clear();
+  searchPending.store(0, std::memory_order_relaxed);
+  sweepCache(true);
+  ca_context_destroy();
+}
+
+/**
+ * @brief How long the idle loop may sleep before it has work, ms, or -1.
+ */
+int AcqEngine::idleWait() const
+{
+  int wait = -1;
+  if (!searchQueue.empty()) {
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+      nextSearch - std::chrono::steady_clock::now()).count();
+    wait = left > 0 ? (int)left : 0;
+  }
+  if (!polled.empty()) {
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+      nextPoll - std::chrono::steady_clock::now()).count();
+    if (wait < 0 || left < wait)
+      wait = left > 0 ? (int)left : 0;
+  }
+  if (!sources.empty() && (wait < 0 || wait > ACQ_SOURCE_POLL_MS))
+    wait = ACQ_SOURCE_POLL_MS;
+  if (restoreJob && (wait < 0 || wait > ACQ_RESTORE_POLL_MS))
+    wait = ACQ_RESTORE_POLL_MS;
+  if (!cache.empty() || !health.empty()) {
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+      lastHealth + std::chrono::milliseconds(ACQ_HEALTH_MS) -
+      std::chrono::steady_clock::now()).count();
+    if (wait < 0 || left < wait)
+      wait = left > 0 ? (int)left : 0;
+  }
+  if (!lingerKeys.empty()) {
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+      nextSweep - std::chrono::steady_clock::now()).count();
+    if (wait < 0 || left < wait)
+      wait = left > 0 ? (int)left : 0;
+  }
+  return wait;
+}
+
+/**
+ * @brief Create the next batch of queued channels if the pacing allows.
+ *
+ * Creating every channel of a large file in one burst floods the name
+ * servers and gateways with search requests, so channels are queued by
+ * priority and released a batch at a time.
+ */
+void AcqEngine::issueSearches()
+{
+  if (searchQueue.empty())
+    return;
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if (now < nextSearch)
+    return;
+  int batch = searchBatch.load(std::memory_order_relaxed);
+  for (int n = 0; n < batch && !searchQueue.empty(); n++) {
+    auto it = cache.find(searchQueue.front());
+    if (it != cache.end() && it->second->queued) {
+      it->second->queued = false;
+      connectChannel(it->second.get(), it->first.first);
+    }
+    searchQueue.pop_front();
+  }
+  ca_flush_io();
+  nextSearch = now + std::chrono::milliseconds(
+    searchInterval.load(std::memory_order_relaxed));
+  searchPending.store((int)searchQueue.size(), std::memory_order_relaxed);
+}
+
+/**
+ * @brief Clear cached channels that have been unreferenced for a while,
+ * or every channel if @p all is set.
+ *
+ * Only the channels left lingering are looked at, and no more often than
+ * every ACQ_CACHE_SWEEP_MS, so wakes for searches, polls and reconnects
+ * do not walk the whole cache. Once ca_clear_channel returns no further
+ * callbacks reference the channel, so it may be freed.
+ */
+void AcqEngine::sweepCache(bool all)
+{
+  if (all) {
+    for (auto &entry : cache) {
+      if (entry.second->ch)
+        ca_clear_channel(entry.second->ch);
+    }
+    cache.clear();
+    lingerKeys.clear();
+    return;
+  }
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if (lingerKeys.empty() || now < nextSweep)
+    return;
+  nextSweep = now + std::chrono::milliseconds(ACQ_CACHE_SWEEP_MS);
+  bool cleared = false;
+  size_t kept = 0;
+  for (size_t k = 0; k < lingerKeys.size(); k++) {
+    auto it = cache.find(lingerKeys[k]);
+    if (it == cache.end() || !it->second->lingering)
+      continue;
+    AcqChannel *c = it->second.get();
+    if (c->releaseAt <= now) {
+      if (c->ch)
+        ca_clear_channel(c->ch);
+      cache.erase(it);
+      cleared = true;
+    } else {
+      lingerKeys[kept++] = lingerKeys[k];
+    }
+  }
+  lingerKeys.resize(kept);
+  if (cleared)
+    ca_flush_io();
+}
+
+/**
+ * @brief Read the channels that are due on a rate rather than a
+ * subscription.
+ *
+ * Channels that are not connected yet are tried again an interval later.
+ */
+void AcqEngine::issueGets()
+{
+  if (polled.empty())
+    return;
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if (now < nextPoll)
+    return;
+  bool issued = false;
+  nextPoll = std::chrono::steady_clock::time_point::max();
+  for (AcqChannel *c : polled) {
+    if (c->nextGet <= now) {
+      long type = acqNativeType(c->ch);
+      if (type >= 0 &&
+          ca_array_get_callback(type, c->waveform ? 0 : 1, c->ch,
+                                acqEventHandler, c) == ECA_NORMAL)
+        issued = true;
+      c->nextGet = now + std::chrono::milliseconds(c->interval);
+    }
+    if (c->nextGet < nextPoll)
+      nextPoll = c->nextGet;
+  }
+  if (issued)
+    ca_flush_io();
+}
+
+bool AcqEngine::arrayShown(int iarray) const
+{
+  return iarray < 0 || iarray >= (int)shown.size() || shown[iarray];
+}
+
+/**
+ * @brief Work out how a claimed channel is read from the arrays that
+ * list it, and switch its subscription to match.
+ *
+ * Only shown arrays count. The channel subscribes if any of them does,
+ * is otherwise read at the fastest of their intervals, and is paused if
+ * none is shown.
+ */
+void AcqEngine::updateMode(AcqChannel *c)
+{
+  bool any = false;
+  int interval = 0;
+  for (const std::pair<int, int> &use : c->uses) {
+    if (!arrayShown(use.first))
+      continue;
+    if (!any)
+      interval = use.second;
+    else if (use.second == 0 || interval == 0)
+      interval = 0;
+    else
+      interval = std::min(interval, use.second);
+    any = true;
+  }
+  c->interval = interval;
+  c->paused = !any;
+  applyInterval(c);
+}
+
+/**
+ * @brief Subscribe a searched channel, or cancel its subscription if it is
+ * paused or read at an interval.
+ *
+ * The native type is only known once the channel connects, so until then
+ * nothing is subscribed; channelUp() brings the channel back here. A
+ * channel whose type changed across an IOC reboot is subscribed afresh.
+ */
+void AcqEngine::applyInterval(AcqChannel *c)
+{
+  if (!c->ch)
+    return;
+  bool subscribe = !c->paused && c->interval == 0;
+  long type = acqNativeType(c->ch);
+  if (subscribe && c->ev && type >= 0 && type != c->evType) {
+    ca_clear_subscription(c->ev);
+    c->ev = nullptr;
+  }
+  if (subscribe && !c->ev) {
+    if (type < 0)
+      return;
+    if (ca_create_subscription(type, c->waveform ? 0 : 1, c->ch,
+                               DBE_VALUE | DBE_ALARM, acqEventHandler,
+                               c, &c->ev) != ECA_NORMAL)
+      c->ev = nullptr;
+    c->evType = type;
+  } else if (!subscribe && c->ev) {
+    ca_clear_subscription(c->ev);
+    c->ev = nullptr;
+  }
+}
+
+/**
+ * @brief Queue a channel that just connected for subscription. Called
+ * from CA callback threads.
+ */
+void AcqEngine::channelUp(const std::string &name, bool waveform)
+{
+  {
+    std::lock_guard<std::mutex> lock(cmdLock);
+    upQueue.emplace_back(name, waveform);
+  }
+  cmdReady.notify_all();
+}
+
+/**
+ * @brief Subscribe the channels that connected since the last call.
+ */
+void AcqEngine::subscribeConnected(std::vector<std::pair<std::string, bool>> &ups)
+{
+  bool any = false;
+  for (const std::pair<std::string, bool> &key : ups) {
+    auto it = cache.find(key);
+    if (it == cache.end())
+      continue;
+    char host[256];
+    if (it->second->ch) {
+      ca_get_host_name(it->second->ch, host, sizeof(host));
+      it->second->host = host;
+    }
+    if (!it->second->claimed)
+      continue;
+    applyInterval(it->second.get());
+    any = true;
+  }
+  ups.clear();
+  if (any)
+    ca_flush_io();
+}
+
+/**
+ * @brief Gather the claimed channels by the IOC serving them, once every
+ * ACQ_HEALTH_MS.
+ *
+ * Rates and latencies come from the counts each channel has accumulated
+ * since the last pass, so the CA callbacks only bump counters. The same
+ * pass sends the heartbeat gets of subscribed channels gone quiet.
+ */
+void AcqEngine::updateHealth()
+{
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if (now < lastHealth + std::chrono::milliseconds(ACQ_HEALTH_MS))
+    return;
+  double dt = std::chrono::duration<double>(now - lastHealth).count();
+  lastHealth = now;
+  double wall = std::chrono::duration<double>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+
+  double beat = heartbeat.load(std::memory_order_relaxed);
+  bool sent = false;
+
+  std::map<std::string, AcqIocHealth> hosts;
+  std::map<std::string, unsigned long> latencyCount;
+  std::map<std::string, double> newest;
+  for (auto &entry : cache) {
+    AcqChannel *c = entry.second.get();
+    if (!c->claimed)
+      continue;
+    AcqIocHealth &h = hosts[c->host];
+    unsigned long updates;
+    double latency;
+    bool quiet;
+    {
+      std::lock_guard<std::mutex> guard(c->lock);
+      h.connected += c->up ? 1 : 0;
+      h.reconnects += c->reconnects;
+      updates = c->updates;
+      latency = c->latencySum;
+      if (c->lastArrival > newest[c->host])
+        newest[c->host] = c->lastArrival;
+      quiet = beat > 0.0 && c->up && c->haveValue &&
+              wall - std::max(c->lastArrival, c->heartbeatSent) >= beat;
+    }
+    if (quiet && c->ev) {
+      if (ca_array_get_callback(c->evType, c->waveform ? 0 : 1, c->ch,
+                                acqHeartbeatHandler, c) == ECA_NORMAL)
+        sent = true;
+      c->heartbeatSent = wall;
+    }
+    h.channels++;
+    h.rate += updates - c->updatesSeen;
+    h.latency += latency - c->latencySeen;
+    latencyCount[c->host] += updates - c->updatesSeen;
+    c->updatesSeen = updates;
+    c->latencySeen = latency;
+  }
+
+  std::vector<AcqIocHealth> result;
+  result.reserve(hosts.size());
+  for (auto &entry : hosts) {
+    AcqIocHealth &h = entry.second;
+    h.host = entry.first;
+    unsigned long n = latencyCount[entry.first];
+    h.latency = n ? h.latency / n : 0.0;
+    h.rate = dt > 0.0 ? h.rate / dt : 0.0;
+    h.age = newest[entry.first] > 0.0 ? wall - newest[entry.first] : -1.0;
+    result.push_back(h);
+  }
+  if (sent)
+    ca_flush_io();
+  std::lock_guard<std::mutex> lock(healthLock);
+  health.swap(result);
+}
+
+/**
+ * @brief Latest per-IOC health of the claimed CA channels, by host.
+ * Called from the GUI thread.
+ */
+std::vector<AcqIocHealth> AcqEngine::iocHealth() const
+{
+  std::lock_guard<std::mutex> lock(healthLock);
+  return health;
+}
+
+/**
+ * @brief Collect the claimed channels read at an interval, all due now.
+ */
+void AcqEngine::rebuildPolled()
+{
+  polled.clear();
+  nextPoll = std::chrono::steady_clock::now();
+  for (auto &entry : cache) {
+    AcqChannel *c = entry.second.get();
+    if (c->claimed && !c->paused && c->interval > 0) {
+      c->nextGet = nextPoll;
+      polled.push_back(c);
+    }
+  }
+}
+
+/**
+ * @brief Find the cached channel for @p name, or queue a new one for
+ * searching, and record that array @p iarray lists it.
+ */
+AcqChannel *AcqEngine::claimChannel(const std::string &name, bool waveform,
+                                    int priority, int iarray, int interval)
+{
+  std::pair<std::string, bool> key(name, waveform);
+  std::unique_ptr<AcqChannel> &slot = cache[key];
+  if (!slot) {
+    slot.reset(new AcqChannel);
+    slot->waveform = waveform;
+    slot->queued = true;
+    slot->priority = priority;
+    slot->engine = this;
+    searchQueue.push_back(key);
+  } else if (slot->queued && (!slot->claimed || priority < slot->priority)) {
+    slot->priority = priority;
+  }
+  if (!slot->claimed)
+    slot->uses.clear();
+  std::pair<int, int> use(iarray, interval);
+  if (slot->uses.empty() || slot->uses.back() != use)
+    slot->uses.push_back(use);
+  slot->claimed = true;
+  slot->lingering = false;
+  return slot.get();
+}
+
+/**
+ * @brief Attach element @p i of an array to its status or threshold
+ * channel, if it names one.
+ *
+ * Validity channels go through the same cache, search queue and
+ * subscriptions as values, and follow the array's interval and
+ * visibility, so checking them costs no polling of its own.
+ */
+void AcqEngine::claimValidity(const AcqArraySpec &spec, int iarray,
+                              const std::shared_ptr<AcqBuffer> &buf, int i, int kind)
+{
+  const std::string &name = kind == AcqTarget::Status ? spec.statusNames[i]
+                                                      : spec.thresholdNames[i];
+  if (name.empty() || name == "-")
+    return;
+  std::string bare;
+  AcqProtocol protocol = splitProtocol(name, spec.sim ? ACQ_SIM : ACQ_CA, bare);
+  if (protocol == ACQ_SIM)
+    return;
+  if (protocol == ACQ_PVA) {
+    fprintf(stderr, "pvAccess validity channels are not supported: %s\n", name.c_str());
+    return;
+  }
+  AcqTarget t;
+  t.buf = buf;
+  t.index = i;
+  t.kind = (AcqTarget::Kind)kind;
+  if (kind == AcqTarget::Threshold) {
+    t.lower = i < (int)spec.thresholdLower.size() ? spec.thresholdLower[i] : 0.0;
+    t.upper = i < (int)spec.thresholdUpper.size() ? spec.thresholdUpper[i] : 0.0;
+  }
+  claimChannel(bare, false, spec.priority, iarray, spec.interval)->pending.push_back(t);
+}
+
+void AcqEngine::pollSources()
+{
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  for (std::unique_ptr<AcqSource> &src : sources) {
+    if (!arrayShown(src->array))
+      continue;
+    if (src->interval > 0) {
+      if (now < src->nextPoll)
+        continue;
+      src->nextPoll = now + std::chrono::milliseconds(src->interval);
+    }
+    src->poll();
+  }
+}
+
+/**
+ * @brief Create a channel and its value subscription, unless it is read
+ * at an interval.
+ *
+ * A count of 0 asks the server for the current native element count, so
+ * waveform updates arrive at whatever length the record holds. Channels
+ * for arrays on screen are created at a higher CA priority, so servers
+ * answer them ahead of hidden ones.
+ */
+void AcqEngine::connectChannel(AcqChannel *c, const std::string &name)
+{
+  int priority = c->paused ? CA_PRIORITY_DEFAULT : ACQ_CA_PRIORITY_SHOWN;
+  c->caPriority = priority;
+  if (ca_create_channel(name.c_str(), acqConnectHandler, c,
+                        priority, &c->ch) != ECA_NORMAL) {
+    fprintf(stderr, "Unable to create channel for %s\n", name.c_str());
+    c->ch = nullptr;
+  } else {
+    applyInterval(c);
+  }
+}
+
+/**
+ * @brief Point the cache at a new set of arrays.
+ *
+ * Targets are collected per unique name first, so a PV listed in several
+ * arrays gets one channel. Channels the new file shares with the old one
+ * are reused; the rest are detached, unsubscribed and left to linger
+ * connected in case the previous file is loaded again. New channels are searched for in
+ * priority order, the first batch right away. Every array counts as shown
+ * until the GUI reports otherwise, so at first that order is by area.
+ */
+void AcqEngine::doLoad(const Command &cmd)
+{
+  sources.clear();
+  shown.assign(cmd.specs.size(), 1);
+  for (auto &entry : cache)
+    entry.second->claimed = false;
+  for (size_t ia = 0; ia < cmd.specs.size(); ia++) {
+    const AcqArraySpec &spec = cmd.specs[ia];
+    std::string bare;
+    if (!spec.waveform.empty()) {
+      AcqProtocol protocol = splitProtocol(spec.waveform, specProtocol(spec), bare);
+      if (protocol == ACQ_SIM) {
+        std::vector<int> all(spec.names.size());
+        for (size_t i = 0; i < all.size(); i++)
+          all[i] = (int)i;
+        connectSim((int)ia, cmd.buffers[ia], spec.names, all, true);
+      } else if (protocol == ACQ_PVA) {
+        connectPvaWaveform((int)ia, cmd.buffers[ia], bare, spec.waveformIndex);
+      } else {
+        AcqTarget t;
+        t.buf = cmd.buffers[ia];
+        t.map = spec.waveformIndex;
+        claimChannel(bare, true, spec.priority, (int)ia, spec.interval)
+          ->pending.push_back(t);
+      }
+      continue;
+    }
+    std::vector<int> pvaIndex, simIndex;
+    std::vector<std::string> pvaNames, simNames;
+    for (size_t i = 0; i < spec.names.size(); i++) {
+      AcqProtocol protocol = splitProtocol(spec.names[i], specProtocol(spec), bare);
+      if (protocol == ACQ_PVA) {
+        pvaIndex.push_back((int)i);
+        pvaNames.push_back(bare);
+        continue;
+      }
+      if (protocol == ACQ_SIM) {
+        simIndex.push_back((int)i);
+        simNames.push_back(bare);
+        continue;
+      }
+      AcqTarget t;
+      t.buf = cmd.buffers[ia];
+      t.index = (int)i;
+      claimChannel(bare, false, spec.priority, (int)ia, spec.interval)
+        ->pending.push_back(t);
+    }
+    for (size_t i = 0; i < spec.names.size(); i++) {
+      if (i < spec.statusNames.size())
+        claimValidity(spec, (int)ia, cmd.buffers[ia], (int)i, AcqTarget::Status);
+      if (i < spec.thresholdNames.size())
+        claimValidity(spec, (int)ia, cmd.buffers[ia], (int)i, AcqTarget::Threshold);
+    }
+    if (!pvaNames.empty())
+      connectPvaScalars((int)ia, cmd.buffers[ia], pvaNames, pvaIndex);
+    if (!simNames.empty())
+      connectSim((int)ia, cmd.buffers[ia], simNames, simIndex, false);
+  }
+  for (std::unique_ptr<AcqSource> &src : sources)
+    src->interval = cmd.specs[src->array].interval;
+
+  std::chrono::steady_clock::time_point releaseAt =
+    std::chrono::steady_clock::now() + std::chrono::seconds(ACQ_CACHE_LINGER);
+  for (auto it = cache.begin(); it != cache.end();) {
+    if (!it->second->claimed && it->second->queued)
+      it = cache.erase(it);
+    else
+      ++it;
+  }
+  auto stale = [this](const std::pair<std::string, bool> &key) {
+    return cache.find(key) == cache.end();
+  };
+  searchQueue.erase(std::remove_if(searchQueue.begin(), searchQueue.end(), stale),
+                    searchQueue.end());
+
+  for (auto &entry : cache) {
+    AcqChannel *c = entry.second.get();
+    if (c->claimed) {
+      updateMode(c);
+      c->setTargets(c->pending);
+    } else if (!c->lingering) {
+      c->setTargets(c->pending);
+      c->lingering = true;
+      c->paused = true;
+      applyInterval(c);
+      c->releaseAt = releaseAt;
+      lingerKeys.push_back(entry.first);
+    }
+  }
+  sortSearches();
+  rebuildPolled();
+  ca_flush_io();
+}
+
+/**
+ * @brief Order the channels still to be searched for: those of shown
+ * arrays first, then by array priority.
+ */
+void AcqEngine::sortSearches()
+{
+  std::stable_sort(searchQueue.begin(), searchQueue.end(),
+                   [this](const std::pair<std::string, bool> &a,
+                          const std::pair<std::string, bool> &b) {
+                     const AcqChannel *ca = cache[a].get();
+                     const AcqChannel *cb = cache[b].get();
+                     if (ca->paused != cb->paused)
+                       return cb->paused;
+                     return ca->priority < cb->priority;
+                   });
+  searchPending.store((int)searchQueue.size(), std::memory_order_relaxed);
+}
+
+/**
+ * @brief Pause the channels of hidden arrays and resume those of shown
+ * ones, and move the searches still queued for shown arrays to the front.
+ *
+ * A CA priority is fixed when the channel is created, and the first
+ * batches go out before the GUI knows what is exposed. Channels that
+ * have never connected and were created at the priority of the other
+ * side are cleared and queued again, so a hidden area does not compete
+ * with shown ones while a large file is still being searched for.
+ * Connected channels keep theirs; while hidden they are paused anyway.
+ */
+void AcqEngine::doVisibility(const Command &cmd)
+{
+  shown.assign(cmd.visible.begin(), cmd.visible.end());
+  for (auto &entry : cache) {
+    AcqChannel *c = entry.second.get();
+    if (!c->claimed)
+      continue;
+    updateMode(c);
+    int priority = c->paused ? CA_PRIORITY_DEFAULT : ACQ_CA_PRIORITY_SHOWN;
+    if (!c->ch || c->caPriority == priority || ca_state(c->ch) != cs_never_conn)
+      continue;
+    ca_clear_channel(c->ch);
+    c->ch = nullptr;
+    c->ev = nullptr;
+    c->evType = -1;
+    {
+      std::lock_guard<std::mutex> guard(c->lock);
+      c->up = false;
+      c->haveValue = false;
+      c->push();
+    }
+    c->queued = true;
+    searchQueue.push_back(entry.first);
+  }
+  sortSearches();
+  rebuildPolled();
+  ca_flush_io();
+}
+
+/**
+ * @brief Start a restore job. pvAccess names fail up front.
+ */
+void AcqEngine::doRestore(const Command &cmd)
+{
+  if (restoreJob)
+    return;
+  restoreJob.reset(new AcqRestoreJob);
+  restoreJob->start = std::chrono::steady_clock::now();
+  restoreJob->nextBatch = restoreJob->start;
+  for (const AcqPut &put : cmd.puts) {
+    std::unique_ptr<AcqPutOp> op(new AcqPutOp);
+    AcqProtocol protocol = splitProtocol(put.name, ACQ_CA, op->name);
+    if (protocol != ACQ_CA) {
+      op->state = AcqPutOp::Failed;
+      op->error = protocol == ACQ_PVA ? "pvAccess is not supported"
+                                      : "Simulated channels cannot be written";
+    }
+    op->value = put.value;
+    restoreJob->ops.push_back(std::move(op));
+  }
+  advanceRestore();
+}
+
+/**
+ * @brief Search for the next batch of restore channels, put to those that
+ * connected, collect completions and time out the rest.
+ *
+ * When every PV is done or failed the channels are cleared and the
+ * report is published.
+ */
+void AcqEngine::advanceRestore()
+{
+  AcqRestoreJob *job = restoreJob.get();
+  if (!job)
+    return;
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  std::chrono::seconds timeout(ACQ_RESTORE_TIMEOUT);
+  int batch = searchBatch.load(std::memory_order_relaxed);
+  bool flush = false;
+
+  if (now >= job->nextBatch && job->next < job->ops.size()) {
+    for (int n = 0; n < batch && job->next < job->ops.size(); n++) {
+      AcqPutOp *op = job->ops[job->next++].get();
+      if (op->state != AcqPutOp::Pending)
+        continue;
+      op->since = now;
+      if (ca_create_channel(op->name.c_str(), acqPutConnectHandler, op,
+                            CA_PRIORITY_DEFAULT, &op->ch) != ECA_NORMAL) {
+        op->ch = nullptr;
+        op->state = AcqPutOp::Failed;
+        op->error = "Unable to create channel";
+      } else {
+        op->state = AcqPutOp::Searching;
+      }
+    }
+    job->nextBatch = now + std::chrono::milliseconds(
+      searchInterval.load(std::memory_order_relaxed));
+    flush = true;
+  }
+
+  int done = 0, failed = 0;
+  for (std::unique_ptr<AcqPutOp> &p : job->ops) {
+    AcqPutOp *op = p.get();
+    if (op->state == AcqPutOp::Searching) {
+      if (op->up.load(std::memory_order_acquire)) {
+        if (job->outstanding < batch) {
+          int st = ca_array_put_callback(DBR_DOUBLE, 1, op->ch, &op->value,
+                                         acqPutHandler, op);
+          if (st != ECA_NORMAL) {
+            op->state = AcqPutOp::Failed;
+            op->error = ca_message(st);
+          } else {
+            op->state = AcqPutOp::Issued;
+            op->since = now;
+            job->outstanding++;
+            flush = true;
+          }
+        }
+      } else if (now - op->since > timeout) {
+        op->state = AcqPutOp::Failed;
+        op->error = "Not connected";
+      }
+    } else if (op->state == AcqPutOp::Issued) {
+      int st = op->status.load(std::memory_order_acquire);
+      if (st >= 0) {
+        job->outstanding--;
+        if (st == ECA_NORMAL) {
+          op->state = AcqPutOp::Done;
+        } else {
+          op->state = AcqPutOp::Failed;
+          op->error = ca_message(st);
+        }
+      } else if (now - op->since > timeout) {
+        job->outstanding--;
+        op->state = AcqPutOp::Failed;
+        op->error = "No completion";
+      }
+    }
+    if (op->state == AcqPutOp::Done)
+      done++;
+    else if (op->state == AcqPutOp::Failed)
+      failed++;
+  }
+  if (flush)
+    ca_flush_io();
+
+  bool finished = (done + failed == (int)job->ops.size());
+  {
+    std::lock_guard<std::mutex> lock(statusLock);
+    status.done = done;
+    status.failed = failed;
+    status.seconds = std::chrono::duration<double>(now - job->start).count();
+    if (finished) {
+      for (std::unique_ptr<AcqPutOp> &op : job->ops) {
+        if (op->state == AcqPutOp::Failed)
+          status.failures.push_back(op->name + ": " + op->error);
+      }
+      status.active = false;
+    }
+  }
+  if (finished) {
+    for (std::unique_ptr<AcqPutOp> &op : job->ops) {
+      if (op->ch)
+        ca_clear_channel(op->ch);
+    }
+    restoreJob.reset();
+    ca_flush_io();
+  }
+}
+
+/**
+ * @brief Create one multi-channel monitor for the pvAccess rows of an array.
+ *
+ * The multi-channel connect waits for the channels, so it runs on a
+ * thread of its own and the source is skipped until it returns; the
+ * acquisition thread goes on with CA meanwhile. Channels that do not
+ * connect within the wait keep trying in the background and join the
+ * monitor when they come up.
+ */
+void AcqEngine::connectPvaScalars(int iarray, const std::shared_ptr<AcqBuffer> &buf,
+                                  const std::vector<std::string> &names,
+                                  const std::vector<int> &index)
+{
+  std::unique_ptr<AcqPvaSource> src(new AcqPvaSource);
+  src->array = iarray;
+  src->buf = buf;
+  src->index = index;
+  try {
+    pvd::shared_vector<std::string> list(names.size());
+    for (size_t k = 0; k < names.size(); k++)
+      list[k] = names[k];
+    pvd::shared_vector<const std::string> frozen(pvd::freeze(list));
+    src->multi = PvaClientMultiChannel::create(PvaClient::get("pva"), frozen,
+                                               "pva", names.size());
+  } catch (std::exception &e) {
+    fprintf(stderr, "pvAccess: %s\n", e.what());
+    return;
+  }
+  src->ready = std::make_shared<std::atomic<bool>>(false);
+  PvaClientMultiChannelPtr multi = src->multi;
+  std::shared_ptr<std::atomic<bool>> ready = src->ready;
+  std::thread([multi, ready]() {
+    try {
+      multi->connect(ACQ_PVA_CONNECT_TIMEOUT);
+      ready->store(true, std::memory_order_release);
+    } catch (std::exception &e) {
+      fprintf(stderr, "pvAccess: %s\n", e.what());
+    }
+  }).detach();
+  sources.push_back(std::move(src));
+}
+
+void AcqEngine::connectPvaWaveform(int iarray, const std::shared_ptr<AcqBuffer> &buf,
+                                   const std::string &name,
+                                   const std::vector<int> &map)
+{
+  std::unique_ptr<AcqPvaSource> src(new AcqPvaSource);
+  src->array = iarray;
+  src->buf = buf;
+  src->map = map;
+  try {
+    src->channel = PvaClient::get("pva")->createChannel(name, "pva");
+    src->channel->issueConnect();
+  } catch (std::exception &e) {
+    fprintf(stderr, "Unable to create channel for %s: %s\n", name.c_str(), e.what());
+    return;
+  }
+  sources.push_back(std::move(src));
+}
+
+/**
+ * @brief Generate the channels of array @p iarray at buffer elements
+ * @p index in process. A waveform page updates all its elements at once.
+ */
+void AcqEngine::connectSim(int iarray, const std::shared_ptr<AcqBuffer> &buf,
+                           const std::vector<std::string> &names,
+                           const std::vector<int> &index, bool waveform)
+{
+  std::unique_ptr<AcqSimSource> src(new AcqSimSource(names, index));
+  src->array = iarray;
+  src->buf = buf;
+  src->waveform = waveform;
+  src->rate = simRate.load(std::memory_order_relaxed);
+  sources.push_back(std::move(src));
+}
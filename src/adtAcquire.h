@@ -0,0 +1,335 @@
+/**
+ * @file adtAcquire.h
+ * @brief Channel Access acquisition engine for the Qt front end.
+ *
+ * All Channel Access work runs on a dedicated thread with preemptive
+ * callbacks enabled. Callbacks write into a per-array back buffer guarded
+ * by a sequence lock, and the GUI copies a consistent frame out of it on
+ * its own schedule, so acquisition never waits on painting, dialogs or
+ * menus and painting never sees a half-updated array.
+ *
+ * @copyright
+ * Copyright (c) 2002 The University of Chicago, as Operator of Argonne National Laboratory.
+ * Copyright (c) 2002 The Regents of the University of California, as Operator of Los Alamos National Laboratory.
+ * Distributed subject to a Software License Agreement found in the file LICENSE that is included with this distribution.
+ */
+
+#ifndef ADT_ACQUIRE_H
+#define ADT_ACQUIRE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Validity flags of an element, from its StatusName channel in the
+ * low bits and from its ThresholdName channel shifted up by
+ * ACQ_THRESHOLD_SHIFT. Zero for elements without validity channels.
+ */
+enum AcqValidity : unsigned char
+{
+  ACQ_INVALID = 1,  /* status InValid, or threshold outside its limits */
+  ACQ_OLDDATA = 2,  /* status OldData */
+  ACQ_NOTCONN = 4   /* the validity channel has no value */
+};
+static constexpr int ACQ_THRESHOLD_SHIFT = 4;
+
+/**
+ * @brief Description of one display array handed to the engine.
+ *
+ * If @c waveform is set, the whole array is filled from that one
+ * array-valued channel and @c names are not connected. Element i takes
+ * waveform element @c waveformIndex[i], or element i when the map is empty.
+ * Names are read over Channel Access unless @c pva is set or the name
+ * carries a "pva://" prefix, and are simulated in process if @c sim is
+ * set or the name carries a "sim://" prefix. Channels of shown arrays,
+ * then of arrays with a lower @c priority, are searched for first. CA
+ * channels of an array with an @c interval, ms, are read at that rate
+ * instead of subscribed to, and its pvAccess and simulated channels are
+ * taken in no more often. Element i may name a status channel and a
+ * threshold channel with its limits; these are read over Channel Access
+ * alongside the values, and "" or "-" means none.
+ */
+struct AcqArraySpec
+{
+  std::vector<std::string> names;
+  std::string waveform;
+  std::vector<int> waveformIndex;
+  bool pva = false;
+  bool sim = false;
+  int priority = 0;
+  int interval = 0;
+  std::vector<std::string> statusNames;
+  std::vector<std::string> thresholdNames;
+  std::vector<double> thresholdLower;
+  std::vector<double> thresholdUpper;
+};
+
+/**
+ * @brief Destination of a frame copy. Side arrays left null are skipped.
+ *
+ * Time stamps are POSIX seconds; severity is the EPICS alarm severity.
+ * Arrivals are the local POSIX times the element's value, or the reply
+ * to a heartbeat read, was last received. If @c changed is set, one bit per element in 64-bit words, the bits
+ * of the elements copied are or'ed into it for the caller to clear.
+ */
+struct AcqFrame
+{
+  double *vals = nullptr;
+  bool *conn = nullptr;
+  double *stamps = nullptr;
+  double *arrivals = nullptr;
+  unsigned char *severity = nullptr;
+  unsigned char *validity = nullptr;
+  uint64_t *changed = nullptr;
+};
+
+/**
+ * @brief Back buffer for one display array.
+ *
+ * Written from CA callback threads under a writer mutex and read by the
+ * GUI without locking. The sequence counter is odd while a write is in
+ * progress; a reader retries if it changed during the copy. Connection
+ * state is kept as a bitset with a running count, and writers flag the
+ * elements they touch so a reader copies only those. An element counts as
+ * connected only once it holds a value received since it last connected.
+ */
+class AcqBuffer
+{
+public:
+  explicit AcqBuffer(int n);
+
+  int size() const
+  {
+    return nvals;
+  }
+
+  int connected() const
+  {
+    return nconn.load(std::memory_order_relaxed);
+  }
+
+  /* Elements that have lost their connection since the buffer was made */
+  unsigned drops() const
+  {
+    return ndrops.load(std::memory_order_relaxed);
+  }
+
+  void store(int index, double value, double stamp, int severity, double arrival);
+  void setConnected(int index, bool up);
+  void storeWaveform(const double *src, long count, const std::vector<int> &map,
+                     double stamp, int severity, double arrival);
+  void setAllConnected(bool up);
+  void storeValidity(int index, int shift, unsigned char flags);
+  void storeBatch(const std::vector<int> &index, const std::vector<double> &values,
+                  const std::vector<char> &up, double stamp);
+  bool read(const AcqFrame &out, uint64_t &seen) const;
+
+private:
+  void beginWrite();
+  void endWrite();
+  bool isConnected(int i) const;
+  void setConnBit(int i, bool up);
+  void markChanged(int i);
+  void markAllChanged();
+  void takeChanged() const;
+  void copyOut(const AcqFrame &out) const;
+
+  int nvals;
+  int nwords;
+  mutable std::mutex writeLock;
+  std::atomic<uint64_t> seq;
+  std::atomic<int> nconn;
+  std::atomic<unsigned> ndrops;
+  std::vector<std::atomic<double>> vals;
+  std::vector<std::atomic<double>> stamps;
+  std::vector<std::atomic<double>> arrivals;
+  std::vector<std::atomic<unsigned char>> severity;
+  std::vector<std::atomic<unsigned char>> validity;
+  /* One bit per element: connected, and written since the last read */
+  std::vector<std::atomic<uint64_t>> connBits;
+  mutable std::vector<std::atomic<uint64_t>> changedBits;
+  /* Reader only: changed bits taken but not yet published */
+  mutable std::vector<uint64_t> readMask;
+};
+
+/**
+ * @brief One value to write back to a PV.
+ */
+struct AcqPut
+{
+  std::string name;
+  double value = 0.0;
+};
+
+/**
+ * @brief Progress of the current or last restore, and its failures once
+ * it has finished.
+ */
+struct AcqRestoreStatus
+{
+  bool active = false;
+  int total = 0;
+  int done = 0;
+  int failed = 0;
+  double seconds = 0.0;
+  std::vector<std::string> failures;
+};
+
+/**
+ * @brief Health of the CA channels served by one IOC. Rate and latency
+ * cover the last second; latency is receipt time less the PV time
+ * stamp, so it includes any clock offset. Channels that have never
+ * connected are grouped under an empty host.
+ */
+struct AcqIocHealth
+{
+  std::string host;
+  int channels = 0;
+  int connected = 0;
+  double rate = 0.0;
+  double age = -1.0;
+  double latency = 0.0;
+  unsigned reconnects = 0;
+};
+
+struct AcqChannel;
+struct AcqSource;
+struct AcqRestoreJob;
+
+/**
+ * @brief Owns the CA context and the acquisition thread.
+ *
+ * Public methods are called from the GUI thread. They only queue work for
+ * the acquisition thread or read back buffers, and never block on the
+ * network.
+ */
+class AcqEngine
+{
+  friend struct AcqChannel;
+
+public:
+  AcqEngine();
+  ~AcqEngine();
+
+  bool start();
+  void stop();
+  bool running() const
+  {
+    return thread.joinable();
+  }
+
+  void setSearchRate(int batch, int intervalMs);
+  void setSimRate(double hz);
+  void setHeartbeat(double seconds);
+  void load(const std::vector<AcqArraySpec> &specs);
+  void setVisible(const std::vector<bool> &visible);
+  bool restore(const std::vector<AcqPut> &puts);
+  AcqRestoreStatus restoreStatus() const;
+  bool read(int iarray, const AcqFrame &out, uint64_t &seen) const;
+  int connected(int iarray) const;
+  unsigned drops(int iarray) const;
+  std::vector<AcqIocHealth> iocHealth() const;
+  /* Channels still waiting to be searched for */
+  int searchesPending() const
+  {
+    return searchPending.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct Command
+  {
+    enum Kind { Load, Visibility, Restore, Quit } kind = Load;
+    std::vector<AcqArraySpec> specs;
+    std::vector<std::shared_ptr<AcqBuffer>> buffers;
+    std::vector<bool> visible;
+    std::vector<AcqPut> puts;
+  };
+
+  void run();
+  void post(Command cmd);
+  void doLoad(const Command &cmd);
+  void doVisibility(const Command &cmd);
+  void doRestore(const Command &cmd);
+  void advanceRestore();
+  int idleWait() const;
+  void sweepCache(bool all);
+  void sortSearches();
+  AcqChannel *claimChannel(const std::string &name, bool waveform, int priority,
+                           int iarray, int interval);
+  void claimValidity(const AcqArraySpec &spec, int iarray,
+                     const std::shared_ptr<AcqBuffer> &buf, int i, int kind);
+  void issueSearches();
+  void issueGets();
+  bool arrayShown(int iarray) const;
+  void updateMode(AcqChannel *c);
+  void applyInterval(AcqChannel *c);
+  void channelUp(const std::string &name, bool waveform);
+  void subscribeConnected(std::vector<std::pair<std::string, bool>> &ups);
+  void updateHealth();
+  void rebuildPolled();
+  void connectChannel(AcqChannel *c, const std::string &name);
+  void pollSources();
+  void connectPvaScalars(int iarray, const std::shared_ptr<AcqBuffer> &buf,
+                         const std::vector<std::string> &names,
+                         const std::vector<int> &index);
+  void connectPvaWaveform(int iarray, const std::shared_ptr<AcqBuffer> &buf,
+                          const std::string &name, const std::vector<int> &map);
+  void connectSim(int iarray, const std::shared_ptr<AcqBuffer> &buf,
+                  const std::vector<std::string> &names,
+                  const std::vector<int> &index, bool waveform);
+
+  std::thread thread;
+  std::mutex cmdLock;
+  std::condition_variable cmdReady;
+  std::deque<Command> commands;
+  /* Channels connected since the acquisition thread last looked, by cache key */
+  std::vector<std::pair<std::string, bool>> upQueue;
+  bool startDone = false;
+  bool startOk = false;
+
+  /* GUI thread view of the current arrays */
+  std::vector<std::shared_ptr<AcqBuffer>> buffers;
+  /* Acquisition thread only: CA channels by (PV name, waveform), kept across loads */
+  std::map<std::pair<std::string, bool>, std::unique_ptr<AcqChannel>> cache;
+  /* Acquisition thread only: cache keys of channels left to linger, and
+     when they are next checked */
+  std::vector<std::pair<std::string, bool>> lingerKeys;
+  std::chrono::steady_clock::time_point nextSweep;
+  /* Acquisition thread only: pvAccess and simulated channels */
+  std::vector<std::unique_ptr<AcqSource>> sources;
+  /* Acquisition thread only: arrays currently on screen */
+  std::vector<char> shown;
+  /* Acquisition thread only: channels not yet searched for, in order */
+  std::deque<std::pair<std::string, bool>> searchQueue;
+  std::chrono::steady_clock::time_point nextSearch;
+  /* Acquisition thread only: claimed channels read at an interval */
+  std::vector<AcqChannel *> polled;
+  std::chrono::steady_clock::time_point nextPoll;
+
+  /* Acquisition thread only: the running restore */
+  std::unique_ptr<AcqRestoreJob> restoreJob;
+  mutable std::mutex statusLock;
+  AcqRestoreStatus status;
+
+  /* Per-IOC health, refreshed by the acquisition thread */
+  std::chrono::steady_clock::time_point lastHealth;
+  mutable std::mutex healthLock;
+  std::vector<AcqIocHealth> health;
+
+  std::atomic<int> searchBatch;
+  std::atomic<int> searchInterval;
+  std::atomic<int> searchPending;
+  std::atomic<double> simRate;
+  std::atomic<double> heartbeat;
+};
+
+#endif
@@ -0,0 +1,451 @@
+/**
+ * @file adtBench.cc
+ * @brief Headless benchmark of the acquisition engine against a local softIoc.
+ *
+ * For each requested channel count a database of changing records is
+ * written, a softIoc serving it is started on localhost, and an AcqEngine
+ * is pointed at it the way the Qt front end would be. A refresh loop then
+ * reads frames at the display rate while update rate, CPU, memory and
+ * frame read time are measured. Each count runs in its own process so
+ * memory figures do not carry over.
+ *
+ * @copyright
+ * Copyright (c) 2002 The University of Chicago, as Operator of Argonne National Laboratory.
+ * Copyright (c) 2002 The Regents of the University of California, as Operator of Los Alamos National Laboratory.
+ * Distributed subject to a Software License Agreement found in the file LICENSE that is included with this distribution.
+ */
+
+#include "adtAcquire.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <cadef.h>
+
+#ifdef _WIN32
+int main()
+{
+  fprintf(stderr, "adtBench: not supported on Windows\n");
+  return 1;
+}
+#else
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Display refresh period the frames are read at, ms */
+#define BENCH_TICK_MS 20
+/* Time measured once everything is connected, s */
+#define BENCH_SECONDS 20
+/* Time allowed for the IOC to start and for the channels to connect, s */
+#define BENCH_IOC_TIMEOUT 120
+#define BENCH_CONNECT_TIMEOUT 600
+
+struct BenchOptions
+{
+  std::string softIoc = "softIoc";
+  std::string scan = ".1 second";
+  std::string dir;
+  int seconds = BENCH_SECONDS;
+  int batch = 0;
+  int interval = 0;
+  bool waveform = false;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+static double since(Clock::time_point t0)
+{
+  return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+static double cpuSeconds()
+{
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+    1e-6 * (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec);
+}
+
+/**
+ * @brief Resident memory of this process, MB: current where /proc has
+ * it, the peak otherwise.
+ */
+static double residentMB()
+{
+  std::ifstream statm("/proc/self/statm");
+  long size = 0, resident = 0;
+  if (statm >> size >> resident)
+    return resident * (double)sysconf(_SC_PAGESIZE) / 1048576.0;
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+#ifdef __APPLE__
+  return ru.ru_maxrss / 1048576.0;
+#else
+  return ru.ru_maxrss / 1024.0;
+#endif
+}
+
+/**
+ * @brief Write the database: @p count calc records producing a new
+ * random value every scan period, or one waveform of @p count elements
+ * that runWriter keeps full and changing.
+ */
+static bool writeDatabase(const std::string &path, const std::string &prefix,
+                          int count, const BenchOptions &opt)
+{
+  FILE *fp = fopen(path.c_str(), "w");
+  if (!fp)
+    return false;
+  if (opt.waveform) {
+    fprintf(fp, "record(waveform, \"%swave\") {\n  field(FTVL, \"DOUBLE\")\n"
+            "  field(NELM, \"%d\")\n}\n", prefix.c_str(), count);
+  } else {
+    for (int i = 0; i < count; i++)
+      fprintf(fp, "record(calc, \"%s%d\") {\n  field(SCAN, \"%s\")\n"
+              "  field(CALC, \"RNDM\")\n}\n", prefix.c_str(), i, opt.scan.c_str());
+  }
+  return fclose(fp) == 0;
+}
+
+/**
+ * @brief Start softIoc on the database with its output going to @p log.
+ * Returns the pid, or -1.
+ */
+static pid_t startIoc(const BenchOptions &opt, const std::string &db, const std::string &log)
+{
+  pid_t pid = fork();
+  if (pid != 0)
+    return pid;
+  FILE *out = freopen(log.c_str(), "w", stdout);
+  if (!out || dup2(fileno(stdout), 2) < 0 || !freopen("/dev/null", "r", stdin))
+    _exit(127);
+  execlp(opt.softIoc.c_str(), opt.softIoc.c_str(), "-S", "-d", db.c_str(), (char *)NULL);
+  _exit(127);
+}
+
+/**
+ * @brief Wait until the IOC log shows it has finished iocInit.
+ */
+static bool waitIoc(pid_t pid, const std::string &log)
+{
+  Clock::time_point t0 = Clock::now();
+  while (since(t0) < BENCH_IOC_TIMEOUT) {
+    int status;
+    if (waitpid(pid, &status, WNOHANG) == pid)
+      return false;
+    std::ifstream in(log.c_str());
+    std::stringstream text;
+    text << in.rdbuf();
+    if (text.str().find("iocRun: All initialization complete") != std::string::npos)
+      return true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  return false;
+}
+
+/**
+ * @brief Body of the waveform writer process: put @p count new random
+ * values to @p name as one array every scan period. Writes a byte to
+ * @p ready once the first full array has been processed, so the
+ * waveform is full length before anything is measured.
+ */
+static int runWriter(const std::string &name, int count, const BenchOptions &opt, int ready)
+{
+  double period = atof(opt.scan.c_str());
+  if (period <= 0.0)
+    period = 0.1;
+  if (ca_context_create(ca_disable_preemptive_callback) != ECA_NORMAL)
+    return 1;
+  chid ch;
+  if (ca_create_channel(name.c_str(), NULL, NULL, CA_PRIORITY_DEFAULT, &ch) != ECA_NORMAL ||
+      ca_pend_io(BENCH_IOC_TIMEOUT) != ECA_NORMAL)
+    return 1;
+  std::vector<double> vals(count);
+  std::mt19937 rng(count);
+  std::uniform_real_distribution<double> dist(0.0, 1.0);
+  for (double &v : vals)
+    v = dist(rng);
+  bool done = false;
+  auto putDone = [](struct event_handler_args args) { *(bool *)args.usr = true; };
+  if (ca_array_put_callback(DBR_DOUBLE, count, ch, vals.data(), putDone, &done) != ECA_NORMAL)
+    return 1;
+  Clock::time_point t0 = Clock::now();
+  while (!done) {
+    if (since(t0) > BENCH_IOC_TIMEOUT)
+      return 1;
+    ca_pend_event(0.01);
+  }
+  if (write(ready, "1", 1) != 1)
+    return 1;
+  close(ready);
+
+  std::chrono::duration<double> tick(period);
+  Clock::time_point due = Clock::now();
+  for (;;) {
+    due += std::chrono::duration_cast<Clock::duration>(tick);
+    std::this_thread::sleep_until(due);
+    for (double &v : vals)
+      v = dist(rng);
+    ca_array_put(DBR_DOUBLE, count, ch, vals.data());
+    ca_flush_io();
+  }
+}
+
+/**
+ * @brief Start the waveform writer and wait for its first full array.
+ * Returns the pid, or -1.
+ */
+static pid_t startWriter(const std::string &name, int count, const BenchOptions &opt)
+{
+  int fds[2];
+  if (pipe(fds) < 0)
+    return -1;
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    _exit(runWriter(name, count, opt, fds[1]));
+  }
+  close(fds[1]);
+  struct pollfd pfd = {fds[0], POLLIN, 0};
+  char byte;
+  bool ok = pid > 0 && poll(&pfd, 1, BENCH_IOC_TIMEOUT * 1000) == 1 && read(fds[0], &byte, 1) == 1;
+  close(fds[0]);
+  if (!ok && pid > 0) {
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    return -1;
+  }
+  return pid;
+}
+
+static void stopIoc(pid_t pid)
+{
+  int status;
+  kill(pid, SIGTERM);
+  for (int i = 0; i < 50; i++) {
+    if (waitpid(pid, &status, WNOHANG) == pid)
+      return;
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  kill(pid, SIGKILL);
+  waitpid(pid, &status, 0);
+}
+
+static double percentile(std::vector<double> v, double p)
+{
+  if (v.empty())
+    return 0.0;
+  size_t k = std::min(v.size() - 1, (size_t)(p * v.size()));
+  std::nth_element(v.begin(), v.begin() + k, v.end());
+  return v[k];
+}
+
+/**
+ * @brief Connect to the IOC and measure. Prints one result row.
+ */
+static int measure(int count, const std::string &prefix, const BenchOptions &opt)
+{
+  AcqEngine engine;
+  engine.setSearchRate(opt.batch, opt.interval);
+  if (!engine.start()) {
+    fprintf(stderr, "adtBench: cannot create the CA context\n");
+    return 1;
+  }
+  std::vector<AcqArraySpec> specs(1);
+  for (int i = 0; i < count; i++)
+    specs[0].names.push_back(opt.waveform ? prefix + "wave[" + std::to_string(i) + "]"
+                                          : prefix + std::to_string(i));
+  if (opt.waveform)
+    specs[0].waveform = prefix + "wave";
+
+  double rss0 = residentMB();
+  Clock::time_point t0 = Clock::now();
+  engine.load(specs);
+  while (engine.connected(0) < count) {
+    if (since(t0) > BENCH_CONNECT_TIMEOUT) {
+      fprintf(stderr, "adtBench: %d of %d channels connected after %d s\n",
+              engine.connected(0), count, BENCH_CONNECT_TIMEOUT);
+      engine.stop();
+      return 1;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  double connectTime = since(t0);
+
+  std::vector<double> vals(count), stamps(count), last(count);
+  std::unique_ptr<bool[]> conn(new bool[count]);
+  AcqFrame frame;
+  frame.vals = vals.data();
+  frame.conn = conn.get();
+  frame.stamps = stamps.data();
+  uint64_t seen = 0;
+  engine.read(0, frame, seen);
+  last = stamps;
+
+  std::chrono::milliseconds tick(BENCH_TICK_MS);
+  std::vector<double> readTime;
+  double updates = 0.0;
+  unsigned drops0 = engine.drops(0);
+  double cpu0 = cpuSeconds();
+  Clock::time_point start = Clock::now(), due = start + tick;
+  while (since(start) < opt.seconds) {
+    std::this_thread::sleep_until(due);
+    Clock::time_point now = Clock::now();
+    due += tick;
+    if (engine.read(0, frame, seen)) {
+      for (int i = 0; i < count; i++) {
+        if (stamps[i] != last[i]) {
+          updates++;
+          last[i] = stamps[i];
+        }
+      }
+    }
+    readTime.push_back(std::chrono::duration<double, std::micro>(Clock::now() - now).count());
+  }
+  double elapsed = since(start);
+  double cpu = cpuSeconds() - cpu0;
+  double rss = residentMB();
+  unsigned drops = engine.drops(0) - drops0;
+  engine.stop();
+
+  double readMean = 0.0;
+  for (double r : readTime)
+    readMean += r;
+  readMean /= std::max<size_t>(1, readTime.size());
+  printf("%7d %9.2f %11.0f %9.2f %6.1f %8.1f %8.1f %8.0f %8.0f %5u\n",
+         count, connectTime, updates / elapsed, updates > 0 ? 1e6 * cpu / updates : 0.0,
+         100.0 * cpu / elapsed, rss, rss - rss0, readMean, percentile(readTime, 0.99),
+         drops);
+  fflush(stdout);
+  return 0;
+}
+
+/**
+ * @brief Run one channel count: database, IOC, measurement, clean up.
+ */
+static int runCount(int count, const BenchOptions &opt)
+{
+  std::string prefix = "adtbench" + std::to_string(getpid()) + ":";
+  std::string db = opt.dir + "/adtbench" + std::to_string(count) + ".db";
+  std::string log = opt.dir + "/adtbench" + std::to_string(count) + ".log";
+  if (!writeDatabase(db, prefix, count, opt)) {
+    fprintf(stderr, "adtBench: cannot write %s\n", db.c_str());
+    return 1;
+  }
+  pid_t ioc = startIoc(opt, db, log);
+  if (ioc < 0) {
+    fprintf(stderr, "adtBench: cannot start %s\n", opt.softIoc.c_str());
+    return 1;
+  }
+  if (!waitIoc(ioc, log)) {
+    fprintf(stderr, "adtBench: %s did not start, see %s\n", opt.softIoc.c_str(), log.c_str());
+    stopIoc(ioc);
+    return 1;
+  }
+  pid_t writer = -1;
+  if (opt.waveform) {
+    writer = startWriter(prefix + "wave", count, opt);
+    if (writer < 0) {
+      fprintf(stderr, "adtBench: cannot fill %swave, see %s\n", prefix.c_str(), log.c_str());
+      stopIoc(ioc);
+      return 1;
+    }
+  }
+  int result = measure(count, prefix, opt);
+  if (writer > 0)
+    stopIoc(writer);
+  stopIoc(ioc);
+  unlink(db.c_str());
+  if (result == 0)
+    unlink(log.c_str());
+  return result;
+}
+
+static void usage(const char *prog)
+{
+  fprintf(stderr,
+    "Usage: %s [-i softIoc] [-s scan] [-t seconds] [-b batch] [-w ms] [-W] count...\n"
+    "  -i <softIoc>   softIoc executable (default softIoc on the PATH)\n"
+    "  -s <scan>      SCAN of the records, or with -W the period of the\n"
+    "                 waveform puts (default \".1 second\")\n"
+    "  -t <seconds>   time measured once all channels connect (default %d)\n"
+    "  -b <batch>     channels searched for at once, as adt -b\n"
+    "  -w <ms>        pause between search batches, as adt -w\n"
+    "  -W             serve one waveform of count elements instead of count records,\n"
+    "                 rewritten whole by a separate writer process\n"
+    "Columns: channels, connect time s, updates/s, CPU us per update, CPU %%,\n"
+    "resident MB and its growth, frame read us mean and p99 at a %d ms\n"
+    "refresh period, and disconnects seen while measuring.\n",
+    prog, BENCH_SECONDS, BENCH_TICK_MS);
+}
+
+int main(int argc, char **argv)
+{
+  BenchOptions opt;
+  std::vector<int> counts;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-i" && i + 1 < argc)
+      opt.softIoc = argv[++i];
+    else if (arg == "-s" && i + 1 < argc)
+      opt.scan = argv[++i];
+    else if (arg == "-t" && i + 1 < argc)
+      opt.seconds = atoi(argv[++i]);
+    else if (arg == "-b" && i + 1 < argc)
+      opt.batch = atoi(argv[++i]);
+    else if (arg == "-w" && i + 1 < argc)
+      opt.interval = atoi(argv[++i]);
+    else if (arg == "-W")
+      opt.waveform = true;
+    else if (atoi(arg.c_str()) > 0)
+      counts.push_back(atoi(arg.c_str()));
+    else {
+      usage(argv[0]);
+      return arg == "-h" || arg == "-?" ? 0 : 1;
+    }
+  }
+  if (counts.empty()) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  /* Keep the search on this host, and let a large waveform through */
+  setenv("EPICS_CA_ADDR_LIST", "127.0.0.1", 1);
+  setenv("EPICS_CA_AUTO_ADDR_LIST", "NO", 1);
+  if (opt.waveform) {
+    int most = *std::max_element(counts.begin(), counts.end());
+    setenv("EPICS_CA_MAX_ARRAY_BYTES", std::to_string(16384 + 8 * most).c_str(), 1);
+  }
+  const char *tmp = getenv("TMPDIR");
+  opt.dir = tmp && *tmp ? tmp : "/tmp";
+
+  printf("# %s, records scanned at \"%s\", %d s per count\n",
+         opt.waveform ? "one waveform" : "scalar records", opt.scan.c_str(), opt.seconds);
+  printf("#  count connect_s   updates/s cpu_us/up  cpu_%%   rss_MB  +rss_MB  read_us"
+         "  read_99 drops\n");
+  fflush(stdout);
+  int failed = 0;
+  for (int count : counts) {
+    pid_t pid = fork();
+    if (pid == 0)
+      _exit(runCount(count, opt));
+    int status = 1;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0)
+      failed++;
+  }
+  return failed ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,480 @@
+/**
+ * @file adtStats.c
+ * @brief Array statistics kernel shared by the Qt and Motif front ends.
+ *
+ * @copyright
+ * Copyright (c) 2002 The University of Chicago, as Operator of Argonne National Laboratory.
+ * Copyright (c) 2002 The Regents of the University of California, as Operator of Los Alamos National Laboratory.
+ * Distributed subject to a Software License Agreement found in the file LICENSE that is included with this distribution.
+ */
+
+#include "adtStats.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+# define ADT_STATS_X86 1
+# include <immintrin.h>
+# ifdef _MSC_VER
+#  include <intrin.h>
+#  define ADT_TARGET_AVX2
+# else
+#  define ADT_TARGET_AVX2 __attribute__((target("avx2")))
+# endif
+#endif
+
+typedef void (*AdtStatsFn)(AdtStats *st, const double *vals, const double *ref,
+                           const uint64_t *use, int n, double *minvals, double *maxvals);
+
+/* Running state of one pass, carried from the vector body to the tail */
+typedef struct
+{
+  double shift;
+  double sum;
+  double sumsq;
+  double max;
+  double maxabs;
+  int imax;
+} AdtStatsAcc;
+
+/**
+ * @brief Index of the lowest set bit of @p bits, which must not be 0.
+ */
+int adtCountTrailingZeros(uint64_t bits)
+{
+#ifdef _MSC_VER
+  unsigned long i;
+  _BitScanForward64(&i, bits);
+  return (int)i;
+#else
+  return __builtin_ctzll(bits);
+#endif
+}
+
+static int countBits(uint64_t bits)
+{
+  int n = 0;
+  for (; bits; bits &= bits - 1)
+    n++;
+  return n;
+}
+
+/**
+ * @brief Mask word @p w of @p use, or of all @p n elements if @p use is
+ * NULL, without bits past the end of the array.
+ */
+static uint64_t useWord(const uint64_t *use, int w, int n)
+{
+  uint64_t bits = use ? use[w] : ~(uint64_t)0;
+  int left = n - w * 64;
+  if (left < 64)
+    bits &= ((uint64_t)1 << left) - 1;
+  return bits;
+}
+
+/**
+ * @brief Start a pass, shifted by the first element taken so that the
+ * sums stay small next to the values.
+ */
+static void statsStart(AdtStatsAcc *acc, const double *vals, const double *ref,
+                       const uint64_t *use, int n)
+{
+  int w;
+  memset(acc, 0, sizeof(*acc));
+  acc->maxabs = -1.0;
+  acc->imax = -1;
+  for (w = 0; w * 64 < n; w++) {
+    uint64_t bits = useWord(use, w, n);
+    if (bits) {
+      int i = w * 64 + adtCountTrailingZeros(bits);
+      acc->shift = ref ? vals[i] - ref[i] : vals[i];
+      if (!isfinite(acc->shift))
+        acc->shift = 0.0;
+      return;
+    }
+  }
+}
+
+/**
+ * @brief Plain C pass over the elements from @p start on.
+ */
+static void statsTail(AdtStatsAcc *acc, const double *vals, const double *ref,
+                      const uint64_t *use, int start, int n, double *minvals, double *maxvals)
+{
+  int w;
+  for (w = start / 64; w * 64 < n; w++) {
+    uint64_t bits = useWord(use, w, n);
+    if (start > w * 64)
+      bits &= ~(uint64_t)0 << (start - w * 64);
+    for (; bits; bits &= bits - 1) {
+      int i = w * 64 + adtCountTrailingZeros(bits);
+      double v = vals[i];
+      double d = ref ? v - ref[i] : v;
+      double ds = d - acc->shift;
+      acc->sum += ds;
+      acc->sumsq += ds * ds;
+      if (fabs(d) > acc->maxabs) {
+        acc->maxabs = fabs(d);
+        acc->max = d;
+        acc->imax = i;
+      }
+      if (minvals) {
+        if (v < minvals[i])
+          minvals[i] = v;
+        if (v > maxvals[i])
+          maxvals[i] = v;
+      }
+    }
+  }
+}
+
+static int countUsed(const uint64_t *use, int n)
+{
+  int w, count = 0;
+  if (!use)
+    return n;
+  for (w = 0; w * 64 < n; w++)
+    count += countBits(useWord(use, w, n));
+  return count;
+}
+
+static void statsFinish(AdtStats *st, const AdtStatsAcc *acc, const uint64_t *use, int n)
+{
+  st->n = countUsed(use, n);
+  st->shift = acc->shift;
+  st->sum = acc->sum;
+  st->sumsq = acc->sumsq;
+  st->max = st->n ? acc->max : 0.0;
+  st->imax = st->n ? acc->imax : -1;
+}
+
+static void statsScalar(AdtStats *st, const double *vals, const double *ref,
+                        const uint64_t *use, int n, double *minvals, double *maxvals)
+{
+  AdtStatsAcc acc;
+  statsStart(&acc, vals, ref, use, n);
+  statsTail(&acc, vals, ref, use, 0, n, minvals, maxvals);
+  statsFinish(st, &acc, use, n);
+}
+
+#ifdef ADT_STATS_X86
+
+/**
+ * @brief Pick the lane with the largest magnitude, the lowest index on
+ * ties, and fold it into @p acc ahead of the tail.
+ */
+static void reduceMax(AdtStatsAcc *acc, const double *maxabs, const double *max,
+                      const double *index, int lanes)
+{
+  int k, best = -1;
+  for (k = 0; k < lanes; k++) {
+    if (maxabs[k] < 0.0)
+      continue;
+    if (best < 0 || maxabs[k] > maxabs[best] ||
+        (maxabs[k] == maxabs[best] && index[k] < index[best]))
+      best = k;
+  }
+  if (best >= 0) {
+    acc->maxabs = maxabs[best];
+    acc->max = max[best];
+    acc->imax = (int)index[best];
+  }
+}
+
+/* Lane masks for each combination of 2 or 4 use bits */
+static const int64_t mask2[4][2] = {
+  {0, 0}, {-1, 0}, {0, -1}, {-1, -1}};
+static const int64_t mask4[16][4] = {
+  {0, 0, 0, 0}, {-1, 0, 0, 0}, {0, -1, 0, 0}, {-1, -1, 0, 0},
+  {0, 0, -1, 0}, {-1, 0, -1, 0}, {0, -1, -1, 0}, {-1, -1, -1, 0},
+  {0, 0, 0, -1}, {-1, 0, 0, -1}, {0, -1, 0, -1}, {-1, -1, 0, -1},
+  {0, 0, -1, -1}, {-1, 0, -1, -1}, {0, -1, -1, -1}, {-1, -1, -1, -1}};
+
+static __m128d select2(__m128d mask, __m128d a, __m128d b)
+{
+  return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+}
+
+/**
+ * @brief SSE2 pass, two elements at a time. SSE2 is part of every x86-64
+ * CPU, so this is the floor there.
+ */
+static void statsSse2(AdtStats *st, const double *vals, const double *ref,
+                      const uint64_t *use, int n, double *minvals, double *maxvals)
+{
+  AdtStatsAcc acc;
+  __m128d vsum = _mm_setzero_pd(), vsq = _mm_setzero_pd();
+  __m128d vmax = _mm_setzero_pd(), vmaxabs = _mm_set1_pd(-1.0), vindex = _mm_setzero_pd();
+  __m128d none = _mm_set1_pd(-1.0), lane = _mm_set_pd(1.0, 0.0), vshift;
+  __m128d absmask = _mm_castsi128_pd(_mm_set1_epi64x(0x7fffffffffffffffLL));
+  int body = n & ~1, w, i;
+  double s[2], q[2], mx[2], ma[2], ix[2];
+
+  statsStart(&acc, vals, ref, use, n);
+  vshift = _mm_set1_pd(acc.shift);
+  for (w = 0; w * 64 < body; w++) {
+    uint64_t bits = useWord(use, w, n);
+    int end = w * 64 + 64 < body ? w * 64 + 64 : body;
+    if (!bits)
+      continue;
+    for (i = w * 64; i < end; i += 2) {
+      unsigned m = (unsigned)(bits >> (i & 63)) & 3;
+      __m128d mask, v, d, ds, a, gt;
+      if (!m)
+        continue;
+      mask = _mm_castsi128_pd(_mm_loadu_si128((const __m128i *)mask2[m]));
+      v = _mm_loadu_pd(vals + i);
+      d = ref ? _mm_sub_pd(v, _mm_loadu_pd(ref + i)) : v;
+      d = _mm_and_pd(d, mask);
+      ds = _mm_and_pd(_mm_sub_pd(d, vshift), mask);
+      vsum = _mm_add_pd(vsum, ds);
+      vsq = _mm_add_pd(vsq, _mm_mul_pd(ds, ds));
+      a = select2(mask, _mm_and_pd(d, absmask), none);
+      gt = _mm_cmpgt_pd(a, vmaxabs);
+      vmaxabs = select2(gt, a, vmaxabs);
+      vmax = select2(gt, d, vmax);
+      vindex = select2(gt, _mm_add_pd(_mm_set1_pd((double)i), lane), vindex);
+      if (minvals) {
+        __m128d lo = _mm_loadu_pd(minvals + i), hi = _mm_loadu_pd(maxvals + i);
+        _mm_storeu_pd(minvals + i, select2(mask, _mm_min_pd(v, lo), lo));
+        _mm_storeu_pd(maxvals + i, select2(mask, _mm_max_pd(v, hi), hi));
+      }
+    }
+  }
+  _mm_storeu_pd(s, vsum);
+  _mm_storeu_pd(q, vsq);
+  _mm_storeu_pd(mx, vmax);
+  _mm_storeu_pd(ma, vmaxabs);
+  _mm_storeu_pd(ix, vindex);
+  acc.sum = s[0] + s[1];
+  acc.sumsq = q[0] + q[1];
+  reduceMax(&acc, ma, mx, ix, 2);
+  statsTail(&acc, vals, ref, use, body, n, minvals, maxvals);
+  statsFinish(st, &acc, use, n);
+}
+
+/**
+ * @brief AVX2 pass, four elements at a time.
+ */
+ADT_TARGET_AVX2
+static void statsAvx2(AdtStats *st, const double *vals, const double *ref,
+                      const uint64_t *use, int n, double *minvals, double *maxvals)
+{
+  AdtStatsAcc acc;
+  __m256d vsum = _mm256_setzero_pd(), vsq = _mm256_setzero_pd();
+  __m256d vmax = _mm256_setzero_pd(), vmaxabs = _mm256_set1_pd(-1.0);
+  __m256d vindex = _mm256_setzero_pd(), vshift;
+  __m256d none = _mm256_set1_pd(-1.0), lane = _mm256_set_pd(3.0, 2.0, 1.0, 0.0);
+  __m256d absmask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffLL));
+  int body = n & ~3, w, i;
+  double s[4], q[4], mx[4], ma[4], ix[4];
+
+  statsStart(&acc, vals, ref, use, n);
+  vshift = _mm256_set1_pd(acc.shift);
+  for (w = 0; w * 64 < body; w++) {
+    uint64_t bits = useWord(use, w, n);
+    int end = w * 64 + 64 < body ? w * 64 + 64 : body;
+    if (!bits)
+      continue;
+    for (i = w * 64; i < end; i += 4) {
+      unsigned m = (unsigned)(bits >> (i & 63)) & 15;
+      __m256d mask, v, d, ds, a, gt;
+      if (!m)
+        continue;
+      mask = _mm256_castsi256_pd(_mm256_loadu_si256((const __m256i *)mask4[m]));
+      v = _mm256_loadu_pd(vals + i);
+      d = ref ? _mm256_sub_pd(v, _mm256_loadu_pd(ref + i)) : v;
+      d = _mm256_and_pd(d, mask);
+      ds = _mm256_and_pd(_mm256_sub_pd(d, vshift), mask);
+      vsum = _mm256_add_pd(vsum, ds);
+      vsq = _mm256_add_pd(vsq, _mm256_mul_pd(ds, ds));
+      a = _mm256_blendv_pd(none, _mm256_and_pd(d, absmask), mask);
+      gt = _mm256_cmp_pd(a, vmaxabs, _CMP_GT_OQ);
+      vmaxabs = _mm256_blendv_pd(vmaxabs, a, gt);
+      vmax = _mm256_blendv_pd(vmax, d, gt);
+      vindex = _mm256_blendv_pd(vindex, _mm256_add_pd(_mm256_set1_pd((double)i), lane), gt);
+      if (minvals) {
+        __m256d lo = _mm256_loadu_pd(minvals + i), hi = _mm256_loadu_pd(maxvals + i);
+        _mm256_storeu_pd(minvals + i, _mm256_blendv_pd(lo, _mm256_min_pd(v, lo), mask));
+        _mm256_storeu_pd(maxvals + i, _mm256_blendv_pd(hi, _mm256_max_pd(v, hi), mask));
+      }
+    }
+  }
+  _mm256_storeu_pd(s, vsum);
+  _mm256_storeu_pd(q, vsq);
+  _mm256_storeu_pd(mx, vmax);
+  _mm256_storeu_pd(ma, vmaxabs);
+  _mm256_storeu_pd(ix, vindex);
+  acc.sum = (s[0] + s[1]) + (s[2] + s[3]);
+  acc.sumsq = (q[0] + q[1]) + (q[2] + q[3]);
+  reduceMax(&acc, ma, mx, ix, 4);
+  statsTail(&acc, vals, ref, use, body, n, minvals, maxvals);
+  statsFinish(st, &acc, use, n);
+}
+
+static int haveAvx2(void)
+{
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7)
+    return 0;
+  __cpuid(info, 1);
+  /* OSXSAVE and AVX, with the YMM state enabled by the OS */
+  if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 ||
+      (_xgetbv(0) & 6) != 6)
+    return 0;
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+static const struct
+{
+  const char *name;
+  AdtStatsFn fn;
+} kernels[] = {
+#ifdef ADT_STATS_X86
+  {"avx2", statsAvx2},
+  {"sse2", statsSse2},
+#endif
+  {"scalar", statsScalar}};
+
+static int selected = -1;
+
+static int kernelUsable(int k)
+{
+#ifdef ADT_STATS_X86
+  if (kernels[k].fn == statsAvx2)
+    return haveAvx2();
+#endif
+  return 1;
+}
+
+/**
+ * @brief Take the elements of @p vals flagged in @p use, all of them if
+ * @p use is NULL, into @p st. Statistics are of vals - @p ref when @p ref
+ * is given. If @p minvals is given, it and @p maxvals are widened to
+ * take in the raw values of the same elements.
+ */
+void adtStatsCompute(AdtStats *st, const double *vals, const double *ref,
+                     const uint64_t *use, int n, double *minvals, double *maxvals)
+{
+  if (selected < 0)
+    adtStatsSelect(NULL);
+  kernels[selected].fn(st, vals, ref, use, n, minvals, maxvals);
+}
+
+/**
+ * @brief Mean and standard deviation from the sums in @p st, both zero
+ * for no elements.
+ */
+void adtStatsMoments(const AdtStats *st, double *avg, double *sdev)
+{
+  AdtRunning r;
+  adtRunningReset(&r, st);
+  adtRunningMoments(&r, avg, sdev);
+}
+
+/**
+ * @brief Start a running accumulator from a full pass.
+ */
+void adtRunningReset(AdtRunning *r, const AdtStats *st)
+{
+  r->n = st->n;
+  r->mean = st->n > 0 ? st->shift + st->sum / st->n : 0.0;
+  r->m2 = st->n > 0 ? st->sumsq - st->sum * st->sum / st->n : 0.0;
+  if (!(r->m2 > 0.0))
+    r->m2 = 0.0;
+}
+
+/**
+ * @brief Take element value @p x in (Welford's update).
+ */
+void adtRunningAdd(AdtRunning *r, double x)
+{
+  double delta = x - r->mean;
+  r->n++;
+  r->mean += delta / r->n;
+  r->m2 += delta * (x - r->mean);
+}
+
+/**
+ * @brief Take element value @p x back out.
+ */
+void adtRunningRemove(AdtRunning *r, double x)
+{
+  double delta;
+  if (r->n <= 1) {
+    r->n = 0;
+    r->mean = r->m2 = 0.0;
+    return;
+  }
+  delta = x - r->mean;
+  r->n--;
+  r->mean -= delta / r->n;
+  r->m2 -= delta * (x - r->mean);
+  if (!(r->m2 > 0.0))
+    r->m2 = 0.0;
+}
+
+/**
+ * @brief An element already taken in changed from @p old to @p x.
+ */
+void adtRunningReplace(AdtRunning *r, double old, double x)
+{
+  double delta = x - old, mean;
+  if (r->n <= 0)
+    return;
+  mean = r->mean + delta / r->n;
+  r->m2 += delta * ((x - mean) + (old - r->mean));
+  r->mean = mean;
+  if (!(r->m2 > 0.0))
+    r->m2 = 0.0;
+}
+
+/**
+ * @brief Mean and population standard deviation, both zero for no
+ * elements.
+ */
+void adtRunningMoments(const AdtRunning *r, double *avg, double *sdev)
+{
+  if (r->n <= 0) {
+    *avg = *sdev = 0.0;
+    return;
+  }
+  *avg = r->mean;
+  *sdev = sqrt(r->m2 / r->n);
+}
+
+/**
+ * @brief Name of the kernel in use.
+ */
+const char *adtStatsKernel(void)
+{
+  if (selected < 0)
+    adtStatsSelect(NULL);
+  return kernels[selected].name;
+}
+
+/**
+ * @brief Use the kernel called @p name, or the fastest this CPU runs if
+ * @p name is NULL. Returns 0 if there is no such kernel here.
+ */
+int adtStatsSelect(const char *name)
+{
+  int k;
+  for (k = 0; k < (int)(sizeof(kernels) / sizeof(kernels[0])); k++) {
+    if ((name && strcmp(name, kernels[k].name) != 0) || !kernelUsable(k))
+      continue;
+    selected = k;
+    return 1;
+  }
+  return 0;
+}
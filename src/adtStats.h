@@ -0,0 +1,65 @@
+/**
+ * @file adtStats.h
+ * @brief Array statistics kernel shared by the Qt and Motif front ends.
+ *
+ * One pass over an array gathers the count, sum, sum of squares and the
+ * element of largest magnitude, and widens the min/max envelope. Sums
+ * are taken about the first element, so arrays sitting on a large
+ * offset keep their precision. A running accumulator then follows
+ * single elements as they change, without another pass. The
+ * elements taken part are given by a bitset, one bit per element in
+ * 64-bit words. The pass is vectorized with SSE2 or AVX2 where the CPU
+ * has them, chosen at run time, and falls back to plain C elsewhere.
+ *
+ * @copyright
+ * Copyright (c) 2002 The University of Chicago, as Operator of Argonne National Laboratory.
+ * Copyright (c) 2002 The Regents of the University of California, as Operator of Los Alamos National Laboratory.
+ * Distributed subject to a Software License Agreement found in the file LICENSE that is included with this distribution.
+ */
+
+#ifndef ADT_STATS_H
+#define ADT_STATS_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Sums over the elements taken by one adtStatsCompute call, of each
+   element less shift */
+typedef struct
+{
+  int n;
+  double shift;
+  double sum;
+  double sumsq;
+  double max;  /* element of largest magnitude, the first one on ties */
+  int imax;    /* its index, -1 if there are no elements */
+} AdtStats;
+
+/* Mean and sum of squared deviations, kept up to date per element */
+typedef struct
+{
+  int n;
+  double mean;
+  double m2;
+} AdtRunning;
+
+void adtStatsCompute(AdtStats *st, const double *vals, const double *ref,
+                     const uint64_t *use, int n, double *minvals, double *maxvals);
+void adtStatsMoments(const AdtStats *st, double *avg, double *sdev);
+void adtRunningReset(AdtRunning *r, const AdtStats *st);
+void adtRunningAdd(AdtRunning *r, double x);
+void adtRunningRemove(AdtRunning *r, double x);
+void adtRunningReplace(AdtRunning *r, double old, double x);
+void adtRunningMoments(const AdtRunning *r, double *avg, double *sdev);
+const char *adtStatsKernel(void);
+int adtCountTrailingZeros(uint64_t bits);
+int adtStatsSelect(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,103 @@
+/**
+ * @file adtStatsBench.c
+ * @brief Microbenchmark of the array statistics kernels.
+ *
+ * Times each kernel this CPU runs on arrays of the given sizes, with
+ * about 5% of the elements masked out as disconnected or invalid ones
+ * would be, and checks each result against the plain C kernel.
+ *
+ * @copyright
+ * Copyright (c) 2002 The University of Chicago, as Operator of Argonne National Laboratory.
+ * Copyright (c) 2002 The Regents of the University of California, as Operator of Los Alamos National Laboratory.
+ * Distributed subject to a Software License Agreement found in the file LICENSE that is included with this distribution.
+ */
+
+#include "adtStats.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* Time spent on each kernel and size, s */
+#define BENCH_SECONDS 0.5
+/* Percent of elements left out of the statistics */
+#define BENCH_MASKED 5
+
+static const char *names[] = {"scalar", "sse2", "avx2"};
+
+static double seconds(void)
+{
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static int agree(double a, double b)
+{
+  return fabs(a - b) <= 1e-9 * (fabs(a) + fabs(b) + 1.0);
+}
+
+static int run(int n)
+{
+  double *vals = malloc(n * sizeof(double)), *ref = malloc(n * sizeof(double));
+  double *lo = malloc(n * sizeof(double)), *hi = malloc(n * sizeof(double));
+  uint64_t *use = calloc((n + 63) / 64, sizeof(uint64_t));
+  AdtStats want, got;
+  int i, k, failed = 0;
+
+  if (!vals || !ref || !lo || !hi || !use) {
+    fprintf(stderr, "adtStatsBench: out of memory\n");
+    exit(1);
+  }
+  srand(n);
+  for (i = 0; i < n; i++) {
+    vals[i] = 150.0 + (rand() / (double)RAND_MAX - 0.5) * 1e-3;
+    ref[i] = 150.0;
+    lo[i] = 1e40;
+    hi[i] = -1e40;
+    if (rand() % 100 >= BENCH_MASKED)
+      use[i >> 6] |= (uint64_t)1 << (i & 63);
+  }
+  adtStatsSelect("scalar");
+  adtStatsCompute(&want, vals, ref, use, n, NULL, NULL);
+
+  for (k = 0; k < (int)(sizeof(names) / sizeof(names[0])); k++) {
+    double t0, elapsed;
+    long reps = 0;
+    if (!adtStatsSelect(names[k]))
+      continue;
+    t0 = seconds();
+    do {
+      adtStatsCompute(&got, vals, ref, use, n, lo, hi);
+      reps++;
+      elapsed = seconds() - t0;
+    } while (elapsed < BENCH_SECONDS);
+    printf("%8d %-8s %8.3f ns/element %10.1f Melements/s%s\n", n, names[k],
+           1e9 * elapsed / ((double)reps * n), 1e-6 * reps * n / elapsed,
+           got.n == want.n && agree(got.sum, want.sum) && agree(got.sumsq, want.sumsq) &&
+           got.max == want.max ? "" : "  MISMATCH");
+    if (got.n != want.n || got.max != want.max)
+      failed = 1;
+  }
+  free(vals);
+  free(ref);
+  free(lo);
+  free(hi);
+  free(use);
+  return failed;
+}
+
+int main(int argc, char **argv)
+{
+  int i, failed = 0;
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s size...\n", argv[0]);
+    return 1;
+  }
+  adtStatsSelect(NULL);
+  printf("# default kernel on this CPU: %s\n", adtStatsKernel());
+  for (i = 1; i < argc; i++)
+    failed |= run(atoi(argv[i]));
+  return failed;
+}
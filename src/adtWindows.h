@@ -0,0 +1,455 @@
+/**
+ * @file adtWindows.h
+ * @brief Per-element statistics over a window of samples, for the Qt
+ * front end.
+ *
+ * Temporal moments over the last samples, Max/Min over a sliding time
+ * window and streaming quantiles, each in fixed memory per element. They
+ * hold no Qt types, so adtWindowsCheck can test them against plain
+ * recomputation.
+ *
+ * @copyright
+ * Copyright (c) 2002 The University of Chicago, as Operator of Argonne National Laboratory.
+ * Copyright (c) 2002 The Regents of the University of California, as Operator of Los Alamos National Laboratory.
+ * Distributed subject to a Software License Agreement found in the file LICENSE that is included with this distribution.
+ */
+
+#ifndef ADT_WINDOWS_H
+#define ADT_WINDOWS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+/* Default samples per element kept for the temporal statistics */
+#define TEMPORAL_WINDOW 100
+/* Windowed Max/Min: time buckets per window, each holding one entry per
+   element and side */
+#define ENVELOPE_DEPTH 32
+
+/* Stands in for a missing minimum or maximum */
+static constexpr double LARGEVAL = 1e40;
+
+// What the main trace shows: the values or one of their temporal statistics
+enum TemporalMode { TEMPORAL_OFF, TEMPORAL_MEAN, TEMPORAL_RMS, TEMPORAL_PTP, TEMPORAL_DRIFT };
+
+/**
+ * @brief Mean, RMS about the mean, peak-to-peak and linear drift of each
+ * element over its last window() samples.
+ *
+ * Samples sit in a fixed ring per element, so memory is set by the
+ * window and never grows. The moments and the value-time covariance are
+ * running sums, updated as a sample enters and the oldest one leaves;
+ * they are taken afresh from the ring each time it wraps, which also
+ * finds the range again when the sample leaving held it.
+ */
+class TemporalStats
+{
+public:
+  /* Size for @p nvals elements; times are kept relative to @p origin */
+  void reset(int nvals, int window, double origin)
+  {
+    nwin = std::max(window, 2);
+    t0 = origin;
+    elems.assign(nvals, Element());
+    times.assign((size_t)nvals * nwin, 0.0);
+    values.assign((size_t)nvals * nwin, 0.0);
+  }
+
+  int window() const
+  {
+    return nwin;
+  }
+
+  /* Samples of element @p i, 0 for an element beyond the size */
+  int count(int i) const
+  {
+    return i < (int)elems.size() ? elems[i].count : 0;
+  }
+
+  /**
+   * @brief Take value @p v of element @p i, stamped @p stamp, POSIX s.
+   * A sample with the time stamp of the last one is the same update and
+   * is skipped; returns whether it was taken.
+   */
+  bool add(int i, double stamp, double v)
+  {
+    Element &e = elems[i];
+    double t = stamp - t0;
+    if (e.count > 0 && t == e.last)
+      return false;
+    double *tv = times.data() + (size_t)i * nwin;
+    double *vv = values.data() + (size_t)i * nwin;
+    bool rescan = false;
+    if (e.count == nwin) {
+      double old = vv[e.head];
+      remove(e, tv[e.head], old);
+      rescan = old <= e.lo || old >= e.hi;
+      e.head = (e.head + 1) % nwin;
+      e.count--;
+      rescan |= e.head == 0;
+    }
+    int slot = (e.head + e.count) % nwin;
+    tv[slot] = t;
+    vv[slot] = v;
+    e.last = t;
+    insert(e, t, v);
+    if (rescan) {
+      recompute(e, tv, vv);
+    } else if (e.count == 1) {
+      e.lo = e.hi = v;
+    } else {
+      e.lo = std::min(e.lo, v);
+      e.hi = std::max(e.hi, v);
+    }
+    return true;
+  }
+
+  /* Statistic @p mode of element @p i, 0 until it has samples; drift is per second */
+  double value(int i, int mode) const
+  {
+    const Element &e = elems[i];
+    if (e.count == 0)
+      return 0.0;
+    switch (mode) {
+    case TEMPORAL_MEAN:
+      return e.meanV;
+    case TEMPORAL_RMS:
+      return std::sqrt(e.m2V / e.count);
+    case TEMPORAL_PTP:
+      return e.hi - e.lo;
+    case TEMPORAL_DRIFT:
+      return e.m2T > 0.0 ? e.cov / e.m2T : 0.0;
+    }
+    return 0.0;
+  }
+
+private:
+  struct Element
+  {
+    int head = 0;  // slot of the oldest sample
+    int count = 0;
+    double last = 0.0;  // time of the newest sample
+    double meanT = 0.0;
+    double meanV = 0.0;
+    double m2T = 0.0;  // sums of squared deviations and of their products
+    double m2V = 0.0;
+    double cov = 0.0;
+    double lo = 0.0;
+    double hi = 0.0;
+  };
+
+  static void insert(Element &e, double t, double v)
+  {
+    double dt = t - e.meanT, dv = v - e.meanV;
+    e.count++;
+    e.meanT += dt / e.count;
+    e.meanV += dv / e.count;
+    e.m2T += dt * (t - e.meanT);
+    e.m2V += dv * (v - e.meanV);
+    e.cov += dt * (v - e.meanV);
+  }
+
+  static void remove(Element &e, double t, double v)
+  {
+    if (e.count <= 1) {
+      e.meanT = e.meanV = e.m2T = e.m2V = e.cov = 0.0;
+      return;
+    }
+    double dt = t - e.meanT, dv = v - e.meanV;
+    int n = e.count - 1;
+    e.meanT -= dt / n;
+    e.meanV -= dv / n;
+    e.m2T = std::max(e.m2T - dt * (t - e.meanT), 0.0);
+    e.m2V = std::max(e.m2V - dv * (v - e.meanV), 0.0);
+    e.cov -= dt * (v - e.meanV);
+  }
+
+  void recompute(Element &e, const double *tv, const double *vv) const
+  {
+    int n = e.count;
+    e.count = 0;
+    e.meanT = e.meanV = e.m2T = e.m2V = e.cov = 0.0;
+    e.lo = e.hi = vv[e.head];
+    for (int k = 0; k < n; ++k) {
+      int slot = (e.head + k) % nwin;
+      insert(e, tv[slot], vv[slot]);
+      e.lo = std::min(e.lo, vv[slot]);
+      e.hi = std::max(e.hi, vv[slot]);
+    }
+  }
+
+  int nwin = TEMPORAL_WINDOW;
+  double t0 = 0.0;
+  std::vector<Element> elems;
+  std::vector<double> times;
+  std::vector<double> values;
+};
+
+/**
+ * @brief Max/Min of each element over a sliding time window.
+ *
+ * Each side of each element is a monotonic deque in a fixed ring: a new
+ * sample pops the entries it beats from the back, so the front is the
+ * extreme, and entries leave the front as they age out. The newest entry
+ * never ages out, since that value still holds. A sample falling in the
+ * same 1/ENVELOPE_DEPTH of the window as the entry behind it only moves
+ * that entry's time on, so the ring stays small and an extreme lasts at
+ * most that much longer than the window.
+ */
+class EnvelopeWindow
+{
+public:
+  /* Ring entries per side: the buckets of one window, and those of the
+     time expiry may run late. Past that the oldest entry is dropped. */
+  static constexpr int SLOTS = ENVELOPE_DEPTH + 4;
+
+  /* Size for @p nvals elements and a window of @p span s */
+  void reset(int nvals, double span)
+  {
+    bucket = span / ENVELOPE_DEPTH;
+    sides.assign((size_t)2 * nvals, Side());
+    times.assign((size_t)2 * nvals * SLOTS, 0.0);
+    values.assign((size_t)2 * nvals * SLOTS, 0.0);
+  }
+
+  /* Take value @p v of element @p i at time @p t, s */
+  void add(int i, double t, double v)
+  {
+    if (!std::isfinite(v))
+      return;
+    push(2 * i, t, v, 1.0);
+    push(2 * i + 1, t, v, -1.0);
+  }
+
+  /* Drop entries taken before @p cutoff; true if the envelope changed */
+  bool expire(int i, double cutoff)
+  {
+    bool changed = false;
+    for (int k = 2 * i; k <= 2 * i + 1; ++k) {
+      Side &d = sides[k];
+      while (d.count > 1 && times[slot(k, 0)] < cutoff) {
+        d.head = (d.head + 1) % SLOTS;
+        d.count--;
+        changed = true;
+      }
+    }
+    return changed;
+  }
+
+  /* Time at which the next entry of element @p i may age out */
+  double due(int i) const
+  {
+    double t = LARGEVAL;
+    for (int k = 2 * i; k <= 2 * i + 1; ++k) {
+      if (sides[k].count > 1)
+        t = std::min(t, times[slot(k, 0)]);
+    }
+    return t;
+  }
+
+  double max(int i) const
+  {
+    return sides[2 * i].count ? values[slot(2 * i, 0)] : -LARGEVAL;
+  }
+
+  double min(int i) const
+  {
+    return sides[2 * i + 1].count ? values[slot(2 * i + 1, 0)] : LARGEVAL;
+  }
+
+private:
+  struct Side
+  {
+    int head = 0;
+    int count = 0;
+  };
+
+  size_t slot(int k, int n) const
+  {
+    return (size_t)k * SLOTS + (sides[k].head + n) % SLOTS;
+  }
+
+  /* Push onto side @p k, kept decreasing in @p sign * value */
+  void push(int k, double t, double v, double sign)
+  {
+    Side &d = sides[k];
+    while (d.count > 0 && sign * values[slot(k, d.count - 1)] <= sign * v)
+      d.count--;
+    if (d.count > 0 && std::floor(times[slot(k, d.count - 1)] / bucket) == std::floor(t / bucket)) {
+      times[slot(k, d.count - 1)] = t;
+      return;
+    }
+    if (d.count == SLOTS) {
+      d.head = (d.head + 1) % SLOTS;
+      d.count--;
+    }
+    times[slot(k, d.count)] = t;
+    values[slot(k, d.count)] = v;
+    d.count++;
+  }
+
+  double bucket = 1.0;
+  std::vector<Side> sides;  // max then min of each element
+  std::vector<double> times;
+  std::vector<double> values;
+};
+
+/* Quantiles followed by a P2Sketch */
+struct BandQuantiles
+{
+  enum { n = 3 };
+  static double p(int j)
+  {
+    static const double v[n] = {0.05, 0.5, 0.95};
+    return v[j];
+  }
+};
+struct MedianQuantile
+{
+  enum { n = 1 };
+  static double p(int)
+  {
+    return 0.5;
+  }
+};
+
+/**
+ * @brief Streaming estimate of the fixed quantiles Q::p by the P²
+ * method of Jain and Chlamtac, extended to several quantiles.
+ *
+ * Markers sit at each quantile, halfway between them and at the
+ * extremes; each sample moves the marker positions and nudges the
+ * heights of those that have drifted from where they belong along a
+ * parabola through their neighbours. Memory is fixed and a sample
+ * costs O(Q::n). Until there are enough samples to place every marker
+ * the quantiles are exact.
+ */
+template <class Q>
+class P2Sketch
+{
+public:
+  enum { M = 2 * Q::n + 3 };
+
+  void add(double x)
+  {
+    if (!std::isfinite(x))
+      return;
+    if (count < M) {
+      int k = (int)count++;
+      for (; k > 0 && q[k - 1] > x; --k)
+        q[k] = q[k - 1];
+      q[k] = x;
+      for (int i = 0; i < M; ++i)
+        pos[i] = i + 1;
+      return;
+    }
+    int k = 0;
+    if (x < q[0]) {
+      q[0] = x;
+    } else if (x >= q[M - 1]) {
+      q[M - 1] = x;
+      k = M - 2;
+    } else {
+      while (x >= q[k + 1])
+        ++k;
+    }
+    for (int i = k + 1; i < M; ++i)
+      pos[i] += 1.0;
+    count += 1.0;
+    for (int i = 1; i < M - 1; ++i) {
+      double d = 1.0 + (count - 1.0) * markerP(i) - pos[i];
+      if ((d >= 1.0 && pos[i + 1] - pos[i] > 1.0) || (d <= -1.0 && pos[i - 1] - pos[i] < -1.0)) {
+        int s = d > 0.0 ? 1 : -1;
+        double h = parabolic(i, s);
+        q[i] = q[i - 1] < h && h < q[i + 1] ? h : q[i] + s * (q[i + s] - q[i]) / (pos[i + s] - pos[i]);
+        pos[i] += s;
+      }
+    }
+  }
+
+  /* Estimate of quantile Q::p(j), 0 with no samples */
+  double quantile(int j) const
+  {
+    if (count <= 0.0)
+      return 0.0;
+    if (count < M) {
+      double r = Q::p(j) * (count - 1.0);
+      int lo = (int)r;
+      int hi = std::min(lo + 1, (int)count - 1);
+      return q[lo] + (r - lo) * (q[hi] - q[lo]);
+    }
+    return q[2 * j + 2];
+  }
+
+  double size() const
+  {
+    return count;
+  }
+
+private:
+  static double markerP(int i)
+  {
+    if (i == 0)
+      return 0.0;
+    if (i == M - 1)
+      return 1.0;
+    if (i % 2 == 0)
+      return Q::p(i / 2 - 1);
+    double below = i == 1 ? 0.0 : Q::p(i / 2 - 1);
+    double above = i == M - 2 ? 1.0 : Q::p(i / 2);
+    return 0.5 * (below + above);
+  }
+
+  double parabolic(int i, int s) const
+  {
+    double n0 = pos[i - 1], n1 = pos[i], n2 = pos[i + 1];
+    return q[i] + s / (n2 - n0) *
+      ((n1 - n0 + s) * (q[i + 1] - q[i]) / (n2 - n1) +
+       (n2 - n1 - s) * (q[i] - q[i - 1]) / (n1 - n0));
+  }
+
+  double count = 0.0;
+  double q[M] = {};
+  double pos[M] = {};  // marker positions, 1-based ranks
+};
+
+/**
+ * @brief Median, 5th and 95th percentiles and median absolute deviation
+ * of a stream of samples, in fixed memory.
+ *
+ * The deviation of each sample is taken from the median estimated when
+ * it arrives, so the MAD settles as the median does.
+ */
+struct RobustStats
+{
+  P2Sketch<BandQuantiles> band;
+  P2Sketch<MedianQuantile> dev;
+
+  void add(double x)
+  {
+    if (!std::isfinite(x))
+      return;
+    band.add(x);
+    dev.add(std::fabs(x - band.quantile(1)));
+  }
+  double low() const
+  {
+    return band.quantile(0);
+  }
+  double median() const
+  {
+    return band.quantile(1);
+  }
+  double high() const
+  {
+    return band.quantile(2);
+  }
+  double mad() const
+  {
+    return dev.quantile(0);
+  }
+};
+
+#endif
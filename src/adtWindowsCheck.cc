@@ -0,0 +1,244 @@
+/**
+ * @file adtWindowsCheck.cc
+ * @brief Checks of the windowed statistics against plain recomputation.
+ *
+ * Feeds fixed pseudo-random streams to TemporalStats, EnvelopeWindow and
+ * RobustStats and compares each with the same quantity taken directly
+ * from the samples it covers: the temporal moments after every sample,
+ * the Max/Min as samples expire and as the ring overflows, and the
+ * quantiles of known distributions. Prints one line per check and exits
+ * non-zero if any fails.
+ *
+ * @copyright
+ * Copyright (c) 2002 The University of Chicago, as Operator of Argonne National Laboratory.
+ * Copyright (c) 2002 The Regents of the University of California, as Operator of Los Alamos National Laboratory.
+ * Distributed subject to a Software License Agreement found in the file LICENSE that is included with this distribution.
+ */
+
+#include "adtWindows.h"
+
+#include <cstdio>
+#include <random>
+
+/* Samples per element fed to each check */
+#define CHECK_SAMPLES 5000
+/* Samples of each distribution fed to the quantile sketches */
+#define CHECK_QUANTILE_SAMPLES 200000
+/* M_PI is not defined by MSVC without _USE_MATH_DEFINES */
+static const double CHECK_TWO_PI = 6.283185307179586;
+
+static int failures = 0;
+
+static void report(const char *what, double err, double tol)
+{
+  bool ok = err <= tol;
+  printf("%-44s error %10.3g  limit %10.3g  %s\n", what, err, tol, ok ? "ok" : "FAILED");
+  if (!ok)
+    failures++;
+}
+
+/* Uniform on [0, 1) from the raw generator, the same on every platform */
+static double uniform(std::mt19937 &rng)
+{
+  return rng() / 4294967296.0;
+}
+
+/* Standard normal by the Box-Muller method */
+static double normal(std::mt19937 &rng)
+{
+  double u = 1.0 - uniform(rng), v = uniform(rng);
+  return std::sqrt(-2.0 * std::log(u)) * std::cos(CHECK_TWO_PI * v);
+}
+
+/**
+ * @brief Compare TemporalStats after every sample with the moments, range
+ * and slope taken in two passes over the samples in its window. Values
+ * sit on a large offset, and every tenth sample repeats the last time
+ * stamp, which must be skipped.
+ */
+static void checkTemporal(int window)
+{
+  const int nvals = 3;
+  std::mt19937 rng(window);
+  TemporalStats ts;
+  ts.reset(nvals, window, 1.0e9);
+  std::vector<std::vector<double>> times(nvals), values(nvals);
+  double errMean = 0.0, errRms = 0.0, errPtp = 0.0, errDrift = 0.0, skipped = 0.0;
+  for (int k = 0; k < CHECK_SAMPLES; ++k) {
+    for (int i = 0; i < nvals; ++i) {
+      bool repeat = k % 10 == 9;
+      double t = 1.0e9 + (repeat ? k - 1 : k) * 0.1;
+      double v = 150.0 + 1e-3 * (uniform(rng) - 0.5) + 1e-6 * k * (i + 1);
+      if (ts.add(i, t, v) == repeat)
+        skipped += 1.0;
+      if (repeat)
+        continue;
+      times[i].push_back(t - 1.0e9);
+      values[i].push_back(v);
+      size_t n = std::min(times[i].size(), (size_t)ts.window());
+      size_t first = times[i].size() - n;
+      double mt = 0.0, mv = 0.0, lo = values[i][first], hi = lo;
+      for (size_t j = first; j < times[i].size(); ++j) {
+        mt += times[i][j];
+        mv += values[i][j];
+        lo = std::min(lo, values[i][j]);
+        hi = std::max(hi, values[i][j]);
+      }
+      mt /= n;
+      mv /= n;
+      double stt = 0.0, svv = 0.0, stv = 0.0;
+      for (size_t j = first; j < times[i].size(); ++j) {
+        double dt = times[i][j] - mt, dv = values[i][j] - mv;
+        stt += dt * dt;
+        svv += dv * dv;
+        stv += dt * dv;
+      }
+      double rms = std::sqrt(svv / n), drift = stt > 0.0 ? stv / stt : 0.0;
+      errMean = std::max(errMean, std::fabs(ts.value(i, TEMPORAL_MEAN) - mv));
+      errRms = std::max(errRms, std::fabs(ts.value(i, TEMPORAL_RMS) - rms));
+      errPtp = std::max(errPtp, std::fabs(ts.value(i, TEMPORAL_PTP) - (hi - lo)));
+      errDrift = std::max(errDrift, std::fabs(ts.value(i, TEMPORAL_DRIFT) - drift));
+    }
+  }
+  char what[64];
+  snprintf(what, sizeof(what), "temporal window %d: repeated stamps", window);
+  report(what, skipped, 0.0);
+  snprintf(what, sizeof(what), "temporal window %d: mean", window);
+  report(what, errMean, 1e-9);
+  snprintf(what, sizeof(what), "temporal window %d: rms", window);
+  report(what, errRms, 1e-9);
+  snprintf(what, sizeof(what), "temporal window %d: peak-to-peak", window);
+  report(what, errPtp, 0.0);
+  snprintf(what, sizeof(what), "temporal window %d: drift", window);
+  report(what, errDrift, 1e-7);
+}
+
+/**
+ * @brief Compare the windowed Max/Min, expired after every sample, with
+ * the extremes of the samples in the window. An extreme may outlast the
+ * window by one bucket, so the result must lie between the extremes over
+ * the window and over the window and one bucket. The newest sample always
+ * counts, even once the stream has gone quiet for longer than the window.
+ */
+static void checkEnvelopeExpiry()
+{
+  const double span = 10.0, bucket = span / ENVELOPE_DEPTH;
+  std::mt19937 rng(17);
+  EnvelopeWindow env;
+  env.reset(1, span);
+  std::vector<double> times, values;
+  double t = 0.0, err = 0.0;
+  for (int k = 0; k < CHECK_SAMPLES; ++k) {
+    t += 0.5 * bucket * uniform(rng);
+    double v = normal(rng);
+    times.push_back(t);
+    values.push_back(v);
+    env.add(0, t, v);
+    env.expire(0, t - span);
+    double innerMax = v, innerMin = v, outerMax = v, outerMin = v;
+    for (size_t j = 0; j < times.size(); ++j) {
+      if (times[j] >= t - span) {
+        innerMax = std::max(innerMax, values[j]);
+        innerMin = std::min(innerMin, values[j]);
+      }
+      if (times[j] >= t - span - bucket) {
+        outerMax = std::max(outerMax, values[j]);
+        outerMin = std::min(outerMin, values[j]);
+      }
+    }
+    if (env.max(0) < innerMax)
+      err = std::max(err, innerMax - env.max(0));
+    if (env.max(0) > outerMax)
+      err = std::max(err, env.max(0) - outerMax);
+    if (env.min(0) > innerMin)
+      err = std::max(err, env.min(0) - innerMin);
+    if (env.min(0) < outerMin)
+      err = std::max(err, outerMin - env.min(0));
+  }
+  report("envelope: Max/Min as samples expire", err, 0.0);
+  env.expire(0, t + span);
+  report("envelope: newest sample outlives the window",
+         std::fabs(env.max(0) - values.back()) + std::fabs(env.min(0) - values.back()), 0.0);
+}
+
+/**
+ * @brief Let the ring overflow by never expiring: with falling values one
+ * bucket apart every sample stays on the max side, so only the newest
+ * SLOTS survive and the max is the oldest of those. The min side keeps
+ * just the newest sample.
+ */
+static void checkEnvelopeEviction()
+{
+  const double span = 10.0, bucket = span / ENVELOPE_DEPTH;
+  const int slots = EnvelopeWindow::SLOTS;
+  EnvelopeWindow env;
+  env.reset(2, span);
+  double err = 0.0;
+  for (int k = 0; k < 3 * slots; ++k) {
+    double v = 1000.0 - k;
+    env.add(1, (k + 0.5) * bucket, v);
+    double oldest = 1000.0 - std::max(0, k - slots + 1);
+    err = std::max(err, std::fabs(env.max(1) - oldest));
+    err = std::max(err, std::fabs(env.min(1) - v));
+  }
+  report("envelope: eviction past SLOTS entries", err, 0.0);
+  report("envelope: untouched element stays empty",
+         std::fabs(env.max(0) + LARGEVAL) + std::fabs(env.min(0) - LARGEVAL), 0.0);
+}
+
+/* Quantile @p p of sorted @p v, interpolated between ranks */
+static double sortedQuantile(const std::vector<double> &v, double p)
+{
+  double r = p * (v.size() - 1);
+  size_t lo = (size_t)r, hi = std::min(lo + 1, v.size() - 1);
+  return v[lo] + (r - lo) * (v[hi] - v[lo]);
+}
+
+/**
+ * @brief Compare RobustStats fed @p n samples of a distribution with the
+ * quantiles of the sorted samples. With fewer samples than markers the
+ * sketch must be exact.
+ */
+static void checkQuantiles(const char *name, int n, double tol,
+                           double (*draw)(std::mt19937 &))
+{
+  std::mt19937 rng(n);
+  RobustStats rs;
+  std::vector<double> v;
+  for (int k = 0; k < n; ++k) {
+    double x = draw(rng);
+    rs.add(x);
+    v.push_back(x);
+  }
+  std::sort(v.begin(), v.end());
+  double err = std::max(std::fabs(rs.low() - sortedQuantile(v, 0.05)),
+                        std::fabs(rs.high() - sortedQuantile(v, 0.95)));
+  err = std::max(err, std::fabs(rs.median() - sortedQuantile(v, 0.5)));
+  char what[64];
+  snprintf(what, sizeof(what), "quantiles: %s, %d samples", name, n);
+  report(what, err, tol);
+  if (n < 100)
+    return;
+  double med = sortedQuantile(v, 0.5);
+  std::vector<double> dev;
+  for (double x : v)
+    dev.push_back(std::fabs(x - med));
+  std::sort(dev.begin(), dev.end());
+  snprintf(what, sizeof(what), "quantiles: %s, MAD", name);
+  report(what, std::fabs(rs.mad() - sortedQuantile(dev, 0.5)), tol);
+}
+
+int main()
+{
+  checkTemporal(2);
+  checkTemporal(7);
+  checkTemporal(TEMPORAL_WINDOW);
+  checkEnvelopeExpiry();
+  checkEnvelopeEviction();
+  checkQuantiles("uniform", 5, 0.0, uniform);
+  checkQuantiles("uniform", CHECK_QUANTILE_SAMPLES, 0.01, uniform);
+  checkQuantiles("normal", CHECK_QUANTILE_SAMPLES, 0.02, normal);
+  if (failures)
+    printf("%d checks FAILED\n", failures);
+  return failures ? 1 : 0;
+}
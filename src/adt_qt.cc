@@ -13,6 +13,9 @@
 
 #include "aps.icon"
 #include "adtVersion.h"
+#include "adtAcquire.h"
+#include "adtStats.h"
+#include "adtWindows.h"
 
 #include <epicsVersion.h>
 #include <QSysInfo>
@@ -37,6 +40,10 @@
 #include <QPen>
 #include <QMessageBox>
 #include <QMouseEvent>
+#include <QEvent>
+#include <QShowEvent>
+#include <QRegion>
+#include <QtAlgorithms>
 #include <QWheelEvent>
 #include <QDoubleSpinBox>
 #include <QSpinBox>
@@ -49,9 +56,13 @@
 #include <QPointF>
 #include <QColor>
 #include <QTimer>
+#include <QMap>
+#include <QDateTime>
 #include <QInputDialog>
 #include <QDialog>
 #include <QDialogButtonBox>
+#include <QCheckBox>
+#include <QPushButton>
 #include <QPointer>
 #include <QPixmap>
 #include <QProcess>
@@ -67,13 +78,34 @@
 
 #include <SDDS.h>
 #include <QDir>
-#include <cadef.h>
 
 #define INITFILENAME "adtrc"
+/* Coherent capture: poll period, ms, and how long to wait, s */
+#define COHERENT_POLL_MS 20
+#define COHERENT_TIMEOUT 10.0
+/* Elements named in the warning when a coherent capture times out */
+#define COHERENT_REPORT 5
+/* Reconnect storm: drops that make one, quiet time that ends it, s,
+   and the repaint period while it lasts, ms */
+#define STORM_CHANNELS 10
+#define STORM_QUIET 5.0
+#define STORM_PAINT_MS 1000
+/* IOCs listed in the Status dialog; Save IOC Health writes them all */
+#define STATUS_IOC_ROWS 20
+/* Element updates per element between full statistics passes, which
+   clear the rounding the running sums pick up */
+#define STATS_RESYNC 64
+/* Most samples per element kept for the temporal statistics */
+#define TEMPORAL_MAX_WINDOW 10000
+/* Windowed Max/Min: the fraction of the window by which expiry may run late */
+#define ENVELOPE_STEPS 100
+/* EPICS alarm severities (alarm.h): MAJOR and up are marked, INVALID is
+   also left out of the statistics */
+#define SEVERITY_MAJOR 2
+#define SEVERITY_INVALID 3
 
 static constexpr int GRIDDIVISIONS = 5;
 static const char *PVID = "ADTPV";
-static constexpr double LARGEVAL = 1e40;
 static const char *SDDSID = "SDDS1";
 static const char *SNAPID = "ADTSNAP";
 
@@ -97,9 +129,29 @@ static bool markers = true, lines = true, bars = false, grid = true,
   refOn = true, referenceLoaded = false;
 static int diffSet = -1, displaySet = -1, nsect = 0;
 static QColor displayColor("Grey40");
+static const QColor staleColor(127, 127, 127);
+static const QColor invalidColor(77, 77, 77);
+static const QColor oldDataColor(127, 127, 127);
 static const QColor backgroundColor("#CCCCCC");
 static const QColor filledMinMaxColor(211, 211, 211, 127);
+// Menu label of each TemporalMode, and the one the main trace shows
+static const char *temporalLabels[] = {"Off", "Mean", "RMS", "Peak-to-Peak", "Drift"};
+static int temporalMode = TEMPORAL_OFF;
+static int temporalWindow = TEMPORAL_WINDOW;
+// Span of the Max/Min envelope in seconds, 0 for all time
+static double envelopeWindow = 0.0;
+// Draw the 5th to 95th percentile band in place of the Max/Min envelope
+static bool percentileBand = false;
 static double nstat = 0.0, nstatTime = 0.0, stotal = 0.0;
+static double staleTime = 0.0;
+// Status and threshold channels in the PV file; status mode 0 off, 1 InValid, 2 all
+static bool checkStatus = false, checkThreshold = false;
+static int checkStatusMode = 2;
+static double coherentWindow = 0.1;
+static int searchBatch = 0, searchInterval = 0;
+// Protocol of pages without ADTProtocol; "sim" simulates every page
+static QString defaultProtocol;
+static double simRate = 0.0;
 static QVector<QString> latNames;
 static QVector<double> latS, latLen;
 static QVector<short> latHeight;
@@ -120,26 +172,66 @@ struct AreaData
   int xStart = 0;
   int xEnd = -1;
 };
-struct ArrayData;
-
-struct GetCallbackData
-{
-  ArrayData *arr = nullptr;
-  int index = 0;
-};
-
 struct ArrayData
 {
   int index = 0;
   int nvals = 0;
   QVector<QString> names;
+  QString waveform;
+  QVector<int> waveformIndex;
+  bool pva = false;
+  bool sim = false;
   QVector<double> vals;
   QVector<double> s;
   QVector<double> minVals;
   QVector<double> maxVals;
   QVector<bool> conn;
-  QVector<chid> chids;
-  QVector<GetCallbackData> cbData;
+  int nconn = 0;
+  QVector<double> stamps;
+  QVector<double> arrivals;  // local receipt time of each element's value
+  QVector<unsigned char> severity;
+  QVector<bool> stale;
+  int nstale = 0;
+  // Min-heap of (due, element) holding each fresh connected element at
+  // most once, and whether it is in it; rebuilt when staleRescan is set
+  std::vector<std::pair<double, int>> staleDue;
+  QVector<bool> staleQueued;
+  bool staleRescan = true;
+  QVector<QString> statusNames;
+  QVector<QString> thresholdNames;
+  QVector<double> thresholdLower;
+  QVector<double> thresholdUpper;
+  QVector<unsigned char> validity;
+  // Bitsets over elements: counted in the statistics, and drawn with a marker
+  QVector<quint64> useMask;
+  QVector<quint64> markMask;
+  int nmarked = 0;
+  // Elements copied or restaled since the statistics last looked, and
+  // the value each counted element was last taken in with
+  QVector<quint64> touched;
+  QVector<double> statVals;
+  AdtRunning stats = {0, 0.0, 0.0};
+  int maxIndex = -1;
+  bool statsFull = true;  // next update takes a full pass
+  long statUpdates = 0;  // element updates since the last full pass
+  TemporalStats temporal;  // sized only while temporalMode is on
+  QVector<double> temporalVals;  // statistic temporalMode of each element
+  QVector<double> sampleStamps;  // time stamp of each element's last sample
+  // Max/Min over the last envelopeWindow seconds, used in place of
+  // minVals and maxVals while it is set
+  EnvelopeWindow envelope;
+  QVector<double> winMin;
+  QVector<double> winMax;
+  double nextEnvelope = 0.0;
+  // Quantiles of each element and of every sample of the array since
+  // the last Reset Max/Min, and the band drawn for percentileBand
+  QVector<RobustStats> robust;
+  RobustStats arrayRobust;
+  QVector<double> bandLo;
+  QVector<double> bandHi;
+  uint64_t frameSeq = 0;
+  unsigned drops = 0;  // engine drop count at the last copy
+  bool dirty = false;
   bool zoom = false;
   QString heading;
   QString units;
@@ -150,12 +242,71 @@ struct ArrayData
   double runSdev = 0.0;
   double runAvg = 0.0;
   double runMax = 0.0;
+  double runN = 0.0;
+  int interval = 0;  // ms between updates, 0 follows the global interval
+  bool shown = true;  // some widget displaying it is on screen
+  bool restore = false;  // ADTRestore: setpoints that Restore writes
   AreaData *area = nullptr;
   QColor color;
   QVector<double> saveVals[NSAVE];
+  QVector<bool> saveConn[NSAVE];  // element connected when the set was stored
   QVector<double> refVals;
 };
 
+static inline bool maskBit(const QVector<quint64> &mask, int i)
+{
+  return (mask[i >> 6] >> (i & 63)) & 1;
+}
+
+/**
+ * @brief Validity flags that keep an element out of the statistics for
+ * the current Check Status mode. An element whose status channel has no
+ * value is always left out; threshold channels are always checked, as
+ * in the Motif version.
+ */
+static unsigned char validityDropFlags()
+{
+  unsigned char status = ACQ_NOTCONN;
+  if (checkStatusMode >= 1)
+    status |= ACQ_INVALID;
+  if (checkStatusMode >= 2)
+    status |= ACQ_OLDDATA;
+  return status | ((ACQ_NOTCONN | ACQ_INVALID) << ACQ_THRESHOLD_SHIFT);
+}
+
+/**
+ * @brief Validity flags drawn with the InValid marker.
+ */
+static unsigned char validityInvalidFlags()
+{
+  return (checkStatusMode >= 1 ? ACQ_INVALID : 0) | (ACQ_INVALID << ACQ_THRESHOLD_SHIFT);
+}
+
+/**
+ * @brief Validity flags drawn with the OldData marker.
+ */
+static unsigned char validityOldFlags()
+{
+  return checkStatusMode >= 2 ? ACQ_OLDDATA : 0;
+}
+
+/**
+ * @brief Text for one validity channel in a plot file, as in the Motif
+ * version.
+ */
+static const char *validityText(const QString &name, bool conn, unsigned char flags)
+{
+  if (name.isEmpty() || name == "-")
+    return "-";
+  if (!conn || (flags & ACQ_NOTCONN))
+    return "NotConnected";
+  if (flags & ACQ_INVALID)
+    return "InValid";
+  if (flags & ACQ_OLDDATA)
+    return "OldData";
+  return "Valid";
+}
+
 class PlotWidget;
 class AreaWidget;
 
@@ -164,7 +315,6 @@ static AreaData *zoomAreaPtr = nullptr;
 static AreaWidget *zoomAreaWidget = nullptr;
 static void updateZoomCenter();
 static void updateZoomInterval();
-static void getCallback(struct event_handler_args args);
 
 struct LoadItem
 {
@@ -178,6 +328,15 @@ struct LoadMenuInfo
   QList<LoadItem> items;
 };
 
+// One array or snapshot page offered by Restore to Machine
+struct RestorePage
+{
+  QString label;
+  bool chosen = false;
+  int skipped = 0;  // elements not connected when stored, left out
+  std::vector<AcqPut> puts;
+};
+
 /**
  * @brief Construct the plotting rectangle.
  *
@@ -591,8 +750,12 @@ protected:
 
     bool refOnLoaded = referenceLoaded && refOn;
     bool diffOn = diffSet >= 0;
+    // Spreads and drift are drawn as they are, without reference or difference
+    bool spread = temporalMode != TEMPORAL_OFF && temporalMode != TEMPORAL_MEAN;
     auto diffVal = [&](ArrayData *arr, const QVector<double> &vec, int idx) {
       double v = vec[idx];
+      if (spread && &vec == &arr->temporalVals)
+        return v * arr->scaleFactor;
       if (refOnLoaded && arr->refVals.size() == arr->nvals)
         v -= arr->refVals[idx];
       if (diffOn && arr->saveVals[diffSet].size() == arr->nvals)
@@ -666,11 +829,16 @@ protected:
       zoomLimits.size() == arrayPtrs.size();
     double zoomXScale = applyZoomLimits ? plotRect.width() / zoomRange : 0.0;
 
-    if (showmaxmin && area != zoomAreaPtr) {
+    if (showmaxmin && area != zoomAreaPtr && !spread) {
       for (int arrIndex = 0; arrIndex < arrayPtrs.size(); ++arrIndex) {
         auto arr = arrayPtrs[arrIndex];
-        if (arr->nvals < 1 || arr->minVals.size() != arr->nvals ||
-            arr->maxVals.size() != arr->nvals)
+        bool windowed = envelopeWindow > 0.0;
+        const QVector<double> &minVals = percentileBand ? arr->bandLo :
+          windowed ? arr->winMin : arr->minVals;
+        const QVector<double> &maxVals = percentileBand ? arr->bandHi :
+          windowed ? arr->winMax : arr->maxVals;
+        if (arr->nvals < 1 || minVals.size() != arr->nvals ||
+            maxVals.size() != arr->nvals)
           continue;
         int start = area->xStart;
         int end = area->xEnd >= area->xStart ? area->xEnd + 1 : arr->nvals;
@@ -689,12 +857,12 @@ protected:
           for (int i = 0; i < count; ++i) {
             int idx = start + i;
             poly[i] = QPointF(xstart + i * xstep,
-              mapY(diffVal(arr, arr->minVals, idx)));
+              mapY(diffVal(arr, minVals, idx)));
           }
           for (int i = 0; i < count; ++i) {
             int idx = start + count - 1 - i;
             poly[count + i] = QPointF(xstart + (count - 1 - i) * xstep,
-              mapY(diffVal(arr, arr->maxVals, idx)));
+              mapY(diffVal(arr, maxVals, idx)));
           }
           pmap.save();
           pmap.setPen(Qt::NoPen);
@@ -706,11 +874,11 @@ protected:
           tmpPts.resize(count);
           for (int i = start; i < end; ++i)
             tmpPts[i - start] = QPointF(xstart + (i - start) * xstep,
-              mapY(diffVal(arr, arr->minVals, i)));
+              mapY(diffVal(arr, minVals, i)));
           pmap.drawPolyline(tmpPts.constData(), count);
           for (int i = start; i < end; ++i)
             tmpPts[i - start] = QPointF(xstart + (i - start) * xstep,
-              mapY(diffVal(arr, arr->maxVals, i)));
+              mapY(diffVal(arr, maxVals, i)));
           pmap.drawPolyline(tmpPts.constData(), count);
           pmap.setPen(Qt::black);
         }
@@ -778,10 +946,48 @@ protected:
       }
     };
 
+    QVector<QPointF> stalePts, alarmPts, invalidPts, oldPts;
+    unsigned char invalidFlags = validityInvalidFlags();
+    auto markPoint = [&](const ArrayData *arr, int i, const QPointF &pt) {
+      if (arr->stale[i])
+        stalePts.append(pt);
+      else if ((arr->validity[i] & invalidFlags) || arr->severity[i] >= SEVERITY_INVALID)
+        invalidPts.append(pt);
+      else if (arr->severity[i] >= SEVERITY_MAJOR)
+        alarmPts.append(pt);
+      else
+        oldPts.append(pt);
+    };
+    auto drawMarks = [&]() {
+      if (stalePts.isEmpty() && alarmPts.isEmpty() && invalidPts.isEmpty() && oldPts.isEmpty())
+        return;
+      pmap.save();
+      pmap.setPen(staleColor);
+      pmap.setBrush(Qt::NoBrush);
+      for (const QPointF &pt : stalePts)
+        pmap.drawRect(QRectF(pt.x() - 2, pt.y() - 2, 4, 4));
+      for (const QPointF &pt : alarmPts)
+        pmap.drawEllipse(pt, 4, 4);
+      pmap.setPen(Qt::NoPen);
+      pmap.setBrush(invalidColor);
+      for (const QPointF &pt : invalidPts)
+        pmap.drawEllipse(pt, 3, 3);
+      pmap.setBrush(oldDataColor);
+      for (const QPointF &pt : oldPts)
+        pmap.drawEllipse(pt, 3, 3);
+      pmap.restore();
+    };
+
     auto drawArray = [&](int arrIndex, ArrayData *arr,
       const QVector<double> &vec, const QColor &clr) {
       if (arr->nvals < 1 || vec.size() != arr->nvals)
         return;
+      bool checkMarks = (&vec == &arr->vals || &vec == &arr->temporalVals) && arr->nmarked > 0 &&
+        arr->markMask.size() * 64 >= arr->nvals;
+      stalePts.clear();
+      alarmPts.clear();
+      invalidPts.clear();
+      oldPts.clear();
       pmap.setPen(clr);
       if (area == zoomAreaPtr) {
         bool drewZoom = false;
@@ -818,6 +1024,8 @@ protected:
                 pmap.drawLine(xi, y0, xi, y);
               if (lines || markers)
                 tmpPts[i] = QPointF(x, y);
+              if (checkMarks && maskBit(arr->markMask, wrapped))
+                markPoint(arr, wrapped, QPointF(x, y));
             }
             if (lines)
               drawPolylineWrapped(tmpPts, zoomDrawWrap);
@@ -829,6 +1037,7 @@ protected:
               pmap.drawPoints(tmpPts.constData(), count);
               pmap.setPen(oldPen);
             }
+            drawMarks();
             drewZoom = true;
           }
         }
@@ -865,6 +1074,8 @@ protected:
             pmap.drawLine(xi, y0, xi, y);
           if (lines || markers)
             tmpPts[i] = QPointF(x, y);
+          if (checkMarks && maskBit(arr->markMask, idx))
+            markPoint(arr, idx, QPointF(x, y));
         }
         if (lines)
           drawPolylineWrapped(tmpPts, zoomDrawWrap);
@@ -876,6 +1087,7 @@ protected:
           pmap.drawPoints(tmpPts.constData(), count);
           pmap.setPen(oldPen);
         }
+        drawMarks();
       } else {
         int start = area->xStart;
         int end = area->xEnd >= area->xStart ? area->xEnd + 1 : arr->nvals;
@@ -898,6 +1110,8 @@ protected:
             pmap.drawLine(xi, y0, xi, y);
           if (lines || markers)
             tmpPts[i - start] = QPointF(x, y);
+          if (checkMarks && maskBit(arr->markMask, i))
+            markPoint(arr, i, QPointF(x, y));
         }
         if (lines)
           pmap.drawPolyline(tmpPts.constData(), count);
@@ -909,10 +1123,11 @@ protected:
           pmap.drawPoints(tmpPts.constData(), count);
           pmap.setPen(oldPen);
         }
+        drawMarks();
       }
     };
 
-    if (displaySet >= 0) {
+    if (displaySet >= 0 && !spread) {
       for (int i = 0; i < arrayPtrs.size(); ++i) {
         auto arr = arrayPtrs[i];
         QColor clr = displayColor;
@@ -924,7 +1139,8 @@ protected:
 
     for (int i = 0; i < arrayPtrs.size(); ++i) {
       auto arr = arrayPtrs[i];
-      drawArray(i, arr, arr->vals, arr->color);
+      bool temporal = temporalMode != TEMPORAL_OFF && arr->temporalVals.size() == arr->nvals;
+      drawArray(i, arr, temporal ? arr->temporalVals : arr->vals, arr->color);
     }
 
       if (this == zoomPlot && nsect > 0 && stotal > 0.0 && !arrayPtrs.isEmpty() &&
@@ -1079,6 +1295,34 @@ protected:
             .arg(arr->names[idx])
             .arg(val, 7, 'f', 3);
           info += line;
+          if (idx == nmid && arr->temporal.count(idx) > 0) {
+            const TemporalStats &ts = arr->temporal;
+            double f = arr->scaleFactor;
+            info += QString("   last %1: mean %2  rms %3  p-p %4  drift %5/s\n")
+              .arg(ts.count(idx))
+              .arg(f * ts.value(idx, TEMPORAL_MEAN), 0, 'f', 3)
+              .arg(f * ts.value(idx, TEMPORAL_RMS), 0, 'f', 3)
+              .arg(f * ts.value(idx, TEMPORAL_PTP), 0, 'f', 3)
+              .arg(f * ts.value(idx, TEMPORAL_DRIFT), 0, 'g', 3);
+          }
+          if (idx == nmid && idx < arr->robust.size() && arr->robust[idx].band.size() > 0) {
+            const RobustStats &rs = arr->robust[idx];
+            double f = arr->scaleFactor;
+            info += QString("   median %1  5%: %2  95%: %3  MAD %4\n")
+              .arg(f * rs.median(), 0, 'f', 3)
+              .arg(f * rs.low(), 0, 'f', 3)
+              .arg(f * rs.high(), 0, 'f', 3)
+              .arg(f * rs.mad(), 0, 'f', 3);
+          }
+        }
+        if (arr->arrayRobust.band.size() > 0) {
+          const RobustStats &rs = arr->arrayRobust;
+          double f = arr->scaleFactor;
+          info += QString("  all: median %1  5%: %2  95%: %3  MAD %4\n")
+            .arg(f * rs.median(), 0, 'f', 3)
+            .arg(f * rs.low(), 0, 'f', 3)
+            .arg(f * rs.high(), 0, 'f', 3)
+            .arg(f * rs.mad(), 0, 'f', 3);
         }
       }
       if (infoBox)
@@ -1593,8 +1837,48 @@ public:
     return plot;
   }
 
+  const QVector<ArrayData *> &arrays() const
+  {
+    return arrayPtrs;
+  }
+
+  /**
+   * @brief Check whether the widget can be seen: shown, in a window that
+   * is not minimized, and not entirely covered.
+   */
+  bool exposed() const
+  {
+    return isVisible() && !window()->isMinimized() && !visibleRegion().isEmpty();
+  }
+
+  bool refreshPending() const
+  {
+    return pendingRefresh;
+  }
+
+  /**
+   * @brief Check whether any displayed array changed since the last tick.
+   */
+  bool hasDirtyArrays() const
+  {
+    for (auto arr : arrayPtrs) {
+      if (arr->dirty)
+        return true;
+    }
+    return false;
+  }
+
+  /**
+   * @brief Update labels and repaint, or defer both until the widget is
+   * exposed again.
+   */
   void refresh()
   {
+    if (!exposed()) {
+      pendingRefresh = true;
+      return;
+    }
+    pendingRefresh = false;
     updateStats();
     updateCenterSectSpin();
     updateIntervalSpin();
@@ -1700,10 +1984,10 @@ private:
     for (int i = 0; i < arrayPtrs.size() && i < stats.size(); ++i) {
       auto arr = arrayPtrs[i];
       auto sl = stats[i];
-      double sdevVal = (statMode && nstat > 0)
-        ? arr->runSdev / nstat : arr->sdev;
-      double avgVal = (statMode && nstat > 0)
-        ? arr->runAvg / nstat : arr->avg;
+      double sdevVal = (statMode && arr->runN > 0)
+        ? arr->runSdev / arr->runN : arr->sdev;
+      double avgVal = (statMode && arr->runN > 0)
+        ? arr->runAvg / arr->runN : arr->avg;
       double maxVal = statMode ? arr->runMax : arr->maxVal;
       sl.sdev->setText(QString("%1").arg(
         sdevVal * arr->scaleFactor, 0, 'f', 3));
@@ -1881,6 +2165,7 @@ private:
 
   AreaData *area;
   QVector<ArrayData *> arrayPtrs;
+  bool pendingRefresh = false;
   PlotWidget *plot;
   QDoubleSpinBox *scaleSpin;
   QDoubleSpinBox *centerSpin;
@@ -1908,25 +2193,6 @@ static void updateZoomInterval()
     zoomAreaWidget->updateIntervalSpin();
 }
 
-/**
- * @brief CA get callback for PV updates.
- *
- * @param args Channel Access event arguments.
- */
-static void getCallback(struct event_handler_args args)
-{
-  GetCallbackData *cb = static_cast<GetCallbackData *>(args.usr);
-  if (!cb || !cb->arr)
-    return;
-  if (args.status == ECA_NORMAL && args.dbr) {
-    cb->arr->vals[cb->index] = *static_cast<const double *>(args.dbr);
-    cb->arr->conn[cb->index] = true;
-  } else {
-    cb->arr->vals[cb->index] = 0.0;
-    cb->arr->conn[cb->index] = false;
-  }
-}
-
 /**
  * @brief Main application window for ADT.
  */
@@ -1938,6 +2204,8 @@ public:
     QWidget *parent = nullptr)
     : QMainWindow(parent), initZoomSector(zoomSect), initZoomInterval(zoomInt)
   {
+    engine.setSearchRate(searchBatch, searchInterval);
+    engine.setSimRate(simRate);
     auto logo = new LogoWidget(this);
     setCentralWidget(logo);
     setAutoFillBackground(true);
@@ -1954,7 +2222,14 @@ public:
         "QMenuBar::item:pressed { background-color: #4767D6; color: white; }");
 
     pollTimer = new QTimer(this);
-    connect(pollTimer, &QTimer::timeout, this, [this]() { pollPvUpdate(); });
+    connect(pollTimer, &QTimer::timeout, this, [this]() { pollPvUpdate(0); });
+    connectTimer = new QTimer(this);
+    connect(connectTimer, &QTimer::timeout, this,
+      [this]() { pollConnections(); });
+    restoreTimer = new QTimer(this);
+    connect(restoreTimer, &QTimer::timeout, this, [this]() { pollRestore(); });
+    coherentTimer = new QTimer(this);
+    connect(coherentTimer, &QTimer::timeout, this, [this]() { pollCoherent(); });
 
     QMenu *fileMenu = menuBar()->addMenu("File");
     adtHome = homeOverride.isEmpty() ?
@@ -2013,6 +2288,13 @@ public:
       QAction *act = writeMenu->addAction(QString::number(i));
       connect(act, &QAction::triggered, this, [this, i]() { writeSaved(i); });
     }
+    QMenu *restoreMenu = fileMenu->addMenu("Restore to Machine");
+    for (int i = 1; i <= NSAVE; ++i) {
+      QAction *act = restoreMenu->addAction(QString::number(i));
+      connect(act, &QAction::triggered, this, [this, i]() { restoreSaved(i); });
+    }
+    QAction *restoreFileAct = restoreMenu->addAction("File...");
+    connect(restoreFileAct, &QAction::triggered, this, [this]() { restoreFile(); });
     QMenu *plotMenu = fileMenu->addMenu("Plot");
     QAction *plotCurAct = plotMenu->addAction("Current");
     connect(plotCurAct, &QAction::triggered, this, [this]() { plotCurrent(); });
@@ -2032,6 +2314,11 @@ public:
       QAction *act = storeMenu->addAction(QString::number(i));
       connect(act, &QAction::triggered, this, [this, i]() { storeSet(i); });
     }
+    QMenu *coherentMenu = optionsMenu->addMenu("Store Coherent");
+    for (int i = 1; i <= NSAVE; ++i) {
+      QAction *act = coherentMenu->addAction(QString::number(i));
+      connect(act, &QAction::triggered, this, [this, i]() { storeCoherent(i); });
+    }
     QMenu *displayMenu = optionsMenu->addMenu("Display");
     QAction *displayOffAct = displayMenu->addAction("Off");
     connect(displayOffAct, &QAction::triggered, this, [this]() { displaySet(0); });
@@ -2046,6 +2333,22 @@ public:
       QAction *act = diffMenu->addAction(QString::number(i));
       connect(act, &QAction::triggered, this, [this, i]() { diffSet(i); });
     }
+    checkStatusMenu = optionsMenu->addMenu("Check Status");
+    const char *checkStatusLabels[] = {"Off", "Check InValid", "Check All"};
+    for (int mode = 0; mode < 3; ++mode) {
+      QAction *act = checkStatusMenu->addAction(checkStatusLabels[mode]);
+      connect(act, &QAction::triggered, this, [this, mode]()
+      {
+        checkStatusMode = mode;
+        for (ArrayData &arr : arrays) {
+          arr.dirty = true;
+          arr.statsFull = true;
+        }
+        updateDirtyStats();
+        refreshDirtyAreas(true);
+      });
+    }
+    checkStatusMenu->setEnabled(checkStatus);
     refAct = optionsMenu->addAction("Reference Enabled");
     refAct->setCheckable(true);
     refAct->setChecked(refOn);
@@ -2062,6 +2365,7 @@ public:
       zoomOn = checked;
       if (zoomWidget)
         zoomWidget->setVisible(zoomOn);
+      updateVisibility();
     });
     QAction *statAct = optionsMenu->addAction("Accumulated Statistics");
     statAct->setCheckable(true);
@@ -2075,6 +2379,7 @@ public:
         arr.runSdev = 0.0;
         arr.runAvg = 0.0;
         arr.runMax = 0.0;
+        arr.runN = 0.0;
       }
       for (AreaData &area : areas)
         area.tempclear = true;
@@ -2082,6 +2387,22 @@ public:
         zoomArea.tempclear = true;
       resetGraph();
     });
+    QMenu *temporalMenu = optionsMenu->addMenu("Temporal");
+    for (int mode = TEMPORAL_OFF; mode <= TEMPORAL_DRIFT; ++mode) {
+      QAction *act = temporalMenu->addAction(temporalLabels[mode]);
+      connect(act, &QAction::triggered, this, [this, mode]()
+      {
+        bool wasOn = temporalMode != TEMPORAL_OFF;
+        temporalMode = mode;
+        if (wasOn != (mode != TEMPORAL_OFF))
+          resetTemporal();
+        for (ArrayData &arr : arrays)
+          refreshTemporal(arr);
+        for (AreaData &area : areas)
+          area.tempclear = true;
+        resetGraph();
+      });
+    }
     auto resetFunc = [this]() { resetFilledExtrema(); };
     QAction *resetAct = optionsMenu->addAction("Reset Max/Min");
     connect(resetAct, &QAction::triggered, this, [resetFunc](bool)
@@ -2111,6 +2432,68 @@ public:
         }
       }
     });
+    QAction *coherentAct = viewMenu->addAction("Coherent Window...");
+    connect(coherentAct, &QAction::triggered, this, [this]()
+    {
+      bool ok = false;
+      QString text = QInputDialog::getText(this, "Coherent Window",
+        "Enter the largest time stamp spread of a coherent set in seconds:",
+        QLineEdit::Normal, QString::number(coherentWindow), &ok);
+      if (ok) {
+        bool okVal = false;
+        double newVal = text.toDouble(&okVal);
+        if (okVal && newVal > 0.0) {
+          coherentWindow = newVal;
+        } else {
+          QMessageBox::warning(this, "ADT",
+            QString("Invalid time value: %1").arg(text));
+        }
+      }
+    });
+    QAction *staleAct = viewMenu->addAction("Stale Time...");
+    connect(staleAct, &QAction::triggered, this, [this]()
+    {
+      bool ok = false;
+      QString text = QInputDialog::getText(this, "Stale Time",
+        "Enter age in seconds after which a value is stale (0 = off):",
+        QLineEdit::Normal, QString::number(staleTime), &ok);
+      if (ok) {
+        bool okVal = false;
+        double newVal = text.toDouble(&okVal);
+        if (okVal && newVal >= 0.0) {
+          staleTime = newVal;
+          engine.setHeartbeat(staleTime / 2.0);
+          for (ArrayData &arr : arrays)
+            arr.staleRescan = true;
+          updateStale();
+          updateDirtyStats();
+          refreshDirtyAreas(true);
+        } else {
+          QMessageBox::warning(this, "ADT",
+            QString("Invalid time value: %1").arg(text));
+        }
+      }
+    });
+    QAction *temporalAct = viewMenu->addAction("Temporal Window...");
+    connect(temporalAct, &QAction::triggered, this, [this]()
+    {
+      bool ok = false;
+      QString text = QInputDialog::getText(this, "Temporal Window",
+        "Enter the number of samples per element for the temporal statistics:",
+        QLineEdit::Normal, QString::number(temporalWindow), &ok);
+      if (ok) {
+        bool okVal = false;
+        int newVal = text.toInt(&okVal);
+        if (okVal && newVal >= 2 && newVal <= TEMPORAL_MAX_WINDOW) {
+          temporalWindow = newVal;
+          resetTemporal();
+          resetGraph();
+        } else {
+          QMessageBox::warning(this, "ADT",
+            QString("Invalid number of samples: %1").arg(text));
+        }
+      }
+    });
     markersAct = viewMenu->addAction("Markers");
     markersAct->setCheckable(true);
     markersAct->setChecked(markers);
@@ -2156,6 +2539,36 @@ public:
       for (auto aw : areaWidgets)
         aw->refresh();
     });
+    QAction *envelopeAct = viewMenu->addAction("Max/Min Window...");
+    connect(envelopeAct, &QAction::triggered, this, [this]()
+    {
+      bool ok = false;
+      QString text = QInputDialog::getText(this, "Max/Min Window",
+        "Enter the span of the Max/Min envelope in seconds (0 = all time):",
+        QLineEdit::Normal, QString::number(envelopeWindow), &ok);
+      if (ok) {
+        bool okVal = false;
+        double newVal = text.toDouble(&okVal);
+        if (okVal && newVal >= 0.0) {
+          envelopeWindow = newVal;
+          for (ArrayData &arr : arrays)
+            resetEnvelope(arr);
+          resetGraph();
+        } else {
+          QMessageBox::warning(this, "ADT",
+            QString("Invalid time value: %1").arg(text));
+        }
+      }
+    });
+    bandAct = viewMenu->addAction("Percentile Band");
+    bandAct->setCheckable(true);
+    bandAct->setChecked(percentileBand);
+    connect(bandAct, &QAction::toggled, this, [this](bool checked)
+    {
+      percentileBand = checked;
+      for (auto aw : areaWidgets)
+        aw->refresh();
+    });
     fillAct = viewMenu->addAction("Filled Max/Min");
     fillAct->setCheckable(true);
     fillAct->setChecked(fillmaxmin);
@@ -2211,40 +2624,63 @@ public:
       QMessageBox::information(this, "ADT Version", msg);
     });
 
-    QMenu *topMenus[] = { fileMenu, optionsMenu, viewMenu, clearMenu, helpMenu };
-    for (QMenu *m : topMenus) {
-      connect(m, &QMenu::aboutToShow, this, [this]()
-      {
-        if (pollTimer)
-          pollTimer->stop();
-      });
-      connect(m, &QMenu::aboutToHide, this, [this]()
-      {
-        if (pollTimer)
-          pollTimer->start(timeInterval);
-      });
+  }
+
+  void changeEvent(QEvent *event) override
+  {
+    QMainWindow::changeEvent(event);
+    if (event->type() == QEvent::WindowStateChange) {
+      updateVisibility();
+      refreshDirtyAreas();
     }
   }
 
   ~MainWindow() override
   {
-    for (chid ch : channels)
-      ca_clear_channel(ch);
-    if (caStarted)
-      ca_context_destroy();
+    engine.stop();
     if (pollTimer)
       pollTimer->stop();
+    stopRateTimers();
+    if (connectTimer)
+      connectTimer->stop();
+    if (restoreTimer)
+      restoreTimer->stop();
+    if (coherentTimer)
+      coherentTimer->stop();
     zoomAreaWidget = nullptr;
     resetFilledExtremaCallback = {};
   }
 
+  /**
+   * @brief Find the earliest and latest time stamp of the connected
+   * elements. Returns false if none is connected.
+   */
+  bool stampRange(double &tmin, double &tmax) const
+  {
+    tmin = LARGEVAL;
+    tmax = -LARGEVAL;
+    for (const ArrayData &arr : arrays) {
+      for (int i = 0; i < arr.nvals; ++i) {
+        if (!arr.conn[i])
+          continue;
+        tmin = std::min(tmin, arr.stamps[i]);
+        tmax = std::max(tmax, arr.stamps[i]);
+      }
+    }
+    return tmax >= tmin;
+  }
+
   void storeSet(int n)
   {
     if (n < 1 || n > NSAVE || arrays.isEmpty())
       return;
     int idx = n - 1;
-    for (ArrayData &arr : arrays)
+    for (ArrayData &arr : arrays) {
       arr.saveVals[idx] = arr.vals;
+      arr.saveConn[idx] = arr.conn;
+    }
+    if (!stampRange(saveStampMin[idx], saveStampMax[idx]))
+      saveStampMin[idx] = saveStampMax[idx] = 0.0;
     time_t now = std::time(nullptr);
     char tbuf[26];
     std::strncpy(tbuf, std::ctime(&now), 24);
@@ -2254,6 +2690,118 @@ public:
     resetGraph();
   }
 
+  /**
+   * @brief Store a set once the element time stamps are coherent.
+   *
+   * Only elements of shown arrays that have sent a new value since the
+   * request are checked, so quiet PVs such as setpoints and paused
+   * arrays do not hold the capture up. The set is taken once the first
+   * of them has had coherentWindow to be joined by the rest and all their
+   * time stamps fall within coherentWindow of each other. Frames are
+   * checked every COHERENT_POLL_MS rather than at the update interval.
+   */
+  void storeCoherent(int n)
+  {
+    if (n < 1 || n > NSAVE || arrays.isEmpty())
+      return;
+    if (coherentTimer->isActive()) {
+      QMessageBox::warning(this, "ADT", "A coherent capture is already in progress");
+      return;
+    }
+    coherentSlot = n - 1;
+    coherentStart = QDateTime::currentMSecsSinceEpoch() / 1000.0;
+    coherentFirst = 0.0;
+    pullFrames();
+    coherentStamps.resize(arrays.size());
+    for (int ia = 0; ia < arrays.size(); ++ia)
+      coherentStamps[ia] = arrays[ia].stamps;
+    coherentTimer->start(COHERENT_POLL_MS);
+    pollCoherent();
+  }
+
+  /**
+   * @brief Whether element @p i of array @p ia counts in a coherent
+   * capture: connected, shown, and updated since the request.
+   */
+  bool coherentElement(int ia, int i) const
+  {
+    const ArrayData &arr = arrays[ia];
+    return arr.shown && arr.conn[i] && ia < coherentStamps.size() &&
+      i < coherentStamps[ia].size() && arr.stamps[i] != coherentStamps[ia][i];
+  }
+
+  /**
+   * @brief Check for a coherent frame. On timeout the latest frame is
+   * stored anyway, and its spread and the elements furthest behind are
+   * reported.
+   */
+  void pollCoherent()
+  {
+    pullFrames();
+    double tmin = LARGEVAL, tmax = -LARGEVAL;
+    int nfresh = 0, nquiet = 0;
+    for (int ia = 0; ia < arrays.size(); ++ia) {
+      const ArrayData &arr = arrays[ia];
+      for (int i = 0; i < arr.nvals; ++i) {
+        if (!coherentElement(ia, i)) {
+          nquiet += arr.conn[i] ? 1 : 0;
+          continue;
+        }
+        tmin = std::min(tmin, arr.stamps[i]);
+        tmax = std::max(tmax, arr.stamps[i]);
+        ++nfresh;
+      }
+    }
+    double now = QDateTime::currentMSecsSinceEpoch() / 1000.0;
+    if (nfresh > 0 && coherentFirst == 0.0)
+      coherentFirst = now;
+    bool coherent = nfresh > 0 && now >= coherentFirst + coherentWindow &&
+      tmax - tmin <= coherentWindow;
+    if (!coherent && now < coherentStart + COHERENT_TIMEOUT)
+      return;
+    coherentTimer->stop();
+    storeSet(coherentSlot + 1);
+    // The slot's spread covers the elements the capture was judged on
+    if (nfresh > 0) {
+      saveStampMin[coherentSlot] = tmin;
+      saveStampMax[coherentSlot] = tmax;
+    }
+    if (coherent)
+      return;
+    if (nfresh == 0) {
+      QMessageBox::warning(this, "ADT",
+        QString("No process variable updated within %1 s. Set %2 was stored "
+          "with the last values.").arg(COHERENT_TIMEOUT).arg(coherentSlot + 1));
+      return;
+    }
+    // Name the elements furthest behind the newest time stamp
+    std::vector<std::pair<double, QString>> behind;
+    for (int ia = 0; ia < arrays.size(); ++ia) {
+      const ArrayData &arr = arrays[ia];
+      for (int i = 0; i < arr.nvals; ++i) {
+        if (coherentElement(ia, i) && tmax - arr.stamps[i] > coherentWindow)
+          behind.emplace_back(tmax - arr.stamps[i], arr.names[i]);
+      }
+    }
+    std::sort(behind.begin(), behind.end(),
+              [](const std::pair<double, QString> &a, const std::pair<double, QString> &b) {
+                return a.first > b.first;
+              });
+    QString list;
+    int nbehind = (int)behind.size();
+    for (int k = 0; k < nbehind && k < COHERENT_REPORT; ++k)
+      list += QString("\n  %1  %2 s behind").arg(behind[k].second).arg(behind[k].first, 0, 'f', 3);
+    if (nbehind > COHERENT_REPORT)
+      list += QString("\n  and %1 more").arg(nbehind - COHERENT_REPORT);
+    QMessageBox::warning(this, "ADT",
+      QString("No coherent data within %1 s. Set %2 was stored with "
+        "time stamps spread over %3 s. %4 of %5 updated process variables "
+        "were more than %6 s behind:%7\n%8 that did not update were not checked.")
+      .arg(COHERENT_TIMEOUT).arg(coherentSlot + 1)
+      .arg(tmax - tmin, 0, 'f', 3).arg(nbehind).arg(nfresh)
+      .arg(coherentWindow).arg(list).arg(nquiet));
+  }
+
   void displaySet(int n)
   {
     if (n >= 1 && n <= NSAVE) {
@@ -2315,10 +2863,14 @@ private:
   QString refFilename;
   QString saveTime[NSAVE];
   QString saveFilename[NSAVE];
+  // Earliest and latest element time stamp of each set, 0 if unknown
+  double saveStampMin[NSAVE] = {};
+  double saveStampMax[NSAVE] = {};
   QVector<ArrayData> arrays;
   QVector<AreaData> areas;
   QVector<AreaWidget *> areaWidgets;
   AreaWidget *zoomWidget = nullptr;
+  QMenu *checkStatusMenu = nullptr;
   QAction *refAct = nullptr;
   QAction *zoomAct = nullptr;
   QAction *markersAct = nullptr;
@@ -2327,6 +2879,7 @@ private:
   QAction *gridAct = nullptr;
   QAction *maxminAct = nullptr;
   QAction *fillAct = nullptr;
+  QAction *bandAct = nullptr;
   AreaData zoomArea;
   bool zoomOn = true;
   int initZoomSector = 0;
@@ -2334,10 +2887,27 @@ private:
   bool zoomSectorUsed = false;
   bool zoomIntervalUsed = false;
   int fileZoomInterval = 0;
-  QVector<chid> channels;
+  AcqEngine engine;
   QTimer *pollTimer = nullptr;
+  QMap<int, QTimer *> rateTimers;
+  QTimer *connectTimer = nullptr;
+  QTimer *restoreTimer = nullptr;
+  QString restoreSource;
+  QTimer *coherentTimer = nullptr;
+  int coherentSlot = 0;
+  double coherentStart = 0.0;
+  double coherentFirst = 0.0;  // when the first updated element was seen
+  QVector<QVector<double>> coherentStamps;  // element time stamps at the request
+  int connectIdleTicks = 0;
+  int lastConnected = 0;
+  // Disconnect episode: channels dropped so far, 0 when none is running
+  int stormDrops = 0;
+  int stormConnected = 0;
+  double stormStart = 0.0;
+  double stormLast = 0.0;
+  qint64 stormPainted = 0;
   int timeInterval = 2000;
-  bool caStarted = false;
+  bool acquiring = false;
   int nsymbols = 0;
 
   void resetFilledExtrema()
@@ -2350,6 +2920,11 @@ private:
       arr.runSdev = 0.0;
       arr.runAvg = 0.0;
       arr.runMax = 0.0;
+      arr.runN = 0.0;
+      arr.dirty = true;
+      arr.statsFull = true;
+      resetEnvelope(arr);
+      resetRobust(arr);
     }
     for (AreaData &area : areas)
       area.tempclear = true;
@@ -2376,82 +2951,649 @@ private:
       maxminAct->setChecked(showmaxmin);
     if (fillAct)
       fillAct->setChecked(fillmaxmin);
+    if (bandAct)
+      bandAct->setChecked(percentileBand);
   }
 
-  void pollPvUpdate()
+  /**
+   * @brief Whether element @p i counts in the statistics and whether it
+   * is drawn with a marker, as bit 0 of @p use and @p flagged.
+   *
+   * An element counts if it is connected, fresh, not in INVALID alarm
+   * and passes the validity check; one is marked if it is connected and
+   * stale, in MAJOR or INVALID alarm, or flagged by the Check Status mode.
+   */
+  static void elementMasks(const ArrayData &arr, int i, unsigned char drop,
+                           unsigned char mark, quint64 &use, quint64 &flagged)
   {
-    if (!caStarted)
-      return;
-    ca_poll();
-    for (ArrayData &arr : arrays) {
-      for (int i = 0; i < arr.nvals; ++i) {
-        if (!arr.chids[i] || ca_state(arr.chids[i]) != cs_conn) {
-          arr.conn[i] = false;
-          arr.vals[i] = 0.0;
+    quint64 conn = arr.conn[i];
+    quint64 stale = arr.stale[i];
+    quint64 alarm = arr.severity[i] >= SEVERITY_MAJOR;
+    quint64 bad = (arr.validity[i] & drop) != 0 || arr.severity[i] >= SEVERITY_INVALID;
+    flagged = conn & (stale | alarm | ((arr.validity[i] & mark) != 0));
+    use = conn & ~stale & ~bad & 1;
+  }
+
+  /**
+   * @brief Rebuild the bitsets of elements counted in the statistics and
+   * of elements drawn with a stale or status marker.
+   */
+  void updateMasks(ArrayData &arr)
+  {
+    int nwords = (arr.nvals + 63) / 64;
+    arr.useMask.fill(0, nwords);
+    arr.markMask.fill(0, nwords);
+    unsigned char drop = validityDropFlags();
+    unsigned char mark = validityInvalidFlags() | validityOldFlags();
+    int nmarked = 0;
+    for (int i = 0; i < arr.nvals; ++i) {
+      quint64 use, flagged;
+      elementMasks(arr, i, drop, mark, use, flagged);
+      arr.useMask[i >> 6] |= use << (i & 63);
+      arr.markMask[i >> 6] |= flagged << (i & 63);
+      nmarked += (int)flagged;
+    }
+    arr.nmarked = nmarked;
+  }
+
+  /**
+   * @brief Take the statistics of @p arr afresh in one pass of the shared
+   * kernel, widening min/max if @p envelope is set.
+   */
+  void fullStats(ArrayData &arr, bool envelope)
+  {
+    AdtStats st;
+    adtStatsCompute(&st, arr.vals.constData(), nullptr,
+      reinterpret_cast<const uint64_t *>(arr.useMask.constData()), arr.nvals,
+      envelope ? arr.minVals.data() : nullptr, envelope ? arr.maxVals.data() : nullptr);
+    adtRunningReset(&arr.stats, &st);
+    arr.maxVal = st.max;
+    arr.maxIndex = st.imax;
+    arr.statVals = arr.vals;
+    arr.statUpdates = 0;
+  }
+
+  /**
+   * @brief Follow the elements of @p arr touched since the last update.
+   *
+   * Each one is moved in or out of the masks and its change is applied
+   * to the running mean and variance, so the cost follows the number of
+   * changed elements rather than the array size. Only losing the element
+   * of largest magnitude needs another pass.
+   */
+  void touchedStats(ArrayData &arr)
+  {
+    unsigned char drop = validityDropFlags();
+    unsigned char mark = validityInvalidFlags() | validityOldFlags();
+    bool rescan = false;
+    for (int w = 0; w < arr.touched.size(); ++w) {
+      quint64 bits = arr.touched[w];
+      for (; bits; bits &= bits - 1) {
+        int b = adtCountTrailingZeros(bits);
+        int i = w * 64 + b;
+        quint64 was = (arr.useMask[w] >> b) & 1;
+        quint64 wasMarked = (arr.markMask[w] >> b) & 1;
+        quint64 use, flagged;
+        elementMasks(arr, i, drop, mark, use, flagged);
+        arr.useMask[w] = (arr.useMask[w] & ~(quint64(1) << b)) | use << b;
+        arr.markMask[w] = (arr.markMask[w] & ~(quint64(1) << b)) | flagged << b;
+        arr.nmarked += (int)flagged - (int)wasMarked;
+        double x = arr.vals[i];
+        if (was && use)
+          adtRunningReplace(&arr.stats, arr.statVals[i], x);
+        else if (was)
+          adtRunningRemove(&arr.stats, arr.statVals[i]);
+        else if (use)
+          adtRunningAdd(&arr.stats, x);
+        else
+          continue;
+        arr.statVals[i] = x;
+        ++arr.statUpdates;
+        double ax = std::fabs(x), am = std::fabs(arr.maxVal);
+        if (use) {
+          if (x < arr.minVals[i])
+            arr.minVals[i] = x;
+          if (x > arr.maxVals[i])
+            arr.maxVals[i] = x;
+        }
+        if (use && (arr.maxIndex < 0 || ax > am || (ax == am && i <= arr.maxIndex))) {
+          arr.maxIndex = i;
+          arr.maxVal = x;
+        } else if (i == arr.maxIndex) {
+          rescan = true;
         }
       }
     }
+    if (rescan || !std::isfinite(arr.stats.m2))
+      fullStats(arr, false);
+  }
+
+  /**
+   * @brief Bring statistics and min/max up to date for arrays marked
+   * dirty.
+   *
+   * Arrays are taken in full after a load, a reset or a change of what
+   * counts, and every STATS_RESYNC updates per element; otherwise only
+   * the touched elements are followed. New values of touched elements
+   * then go into their temporal windows.
+   */
+  void updateDirtyStats()
+  {
     for (ArrayData &arr : arrays) {
-      double sum = 0.0;
-      double sumsq = 0.0;
-      double maxv = 0.0;
-      int nconn = 0;
-      bool haveMax = false;
-      for (int i = 0; i < arr.nvals; ++i) {
-        if (!arr.conn[i])
-          continue;
-        double v = arr.vals[i];
-        sum += v;
-        sumsq += v * v;
-        if (!haveMax || std::fabs(v) > std::fabs(maxv)) {
-          maxv = v;
-          haveMax = true;
-        }
-        if (v < arr.minVals[i])
-          arr.minVals[i] = v;
-        if (v > arr.maxVals[i])
-          arr.maxVals[i] = v;
-        ++nconn;
-      }
-      if (nconn > 0) {
-        arr.avg = sum / nconn;
-        arr.sdev = std::sqrt(sumsq / nconn - arr.avg * arr.avg);
-        arr.maxVal = maxv;
+      if (!arr.dirty)
+        continue;
+      if (arr.statsFull || arr.statUpdates > STATS_RESYNC * (long)arr.nvals) {
+        updateMasks(arr);
+        fullStats(arr, true);
+        arr.statsFull = false;
       } else {
-        arr.avg = arr.sdev = arr.maxVal = 0.0;
+        touchedStats(arr);
       }
+      adtRunningMoments(&arr.stats, &arr.avg, &arr.sdev);
+      sampleTouched(arr);
     }
-    nstat += 1.0;
-    nstatTime += timeInterval;
-    for (ArrayData &arr : arrays) {
-      arr.runSdev += arr.sdev;
-      arr.runAvg += arr.avg;
-      if (std::fabs(arr.maxVal) > std::fabs(arr.runMax))
-        arr.runMax = arr.maxVal;
+  }
+
+  /**
+   * @brief Add the touched elements that count in the statistics to their
+   * temporal and Max/Min windows and quantile sketches, and clear the
+   * touched bits. Only a new time stamp makes a new temporal or quantile
+   * sample.
+   */
+  void sampleTouched(ArrayData &arr)
+  {
+    bool show = temporalMode != TEMPORAL_OFF;
+    bool windowed = envelopeWindow > 0.0;
+    double now = QDateTime::currentMSecsSinceEpoch() / 1000.0;
+    for (int w = 0; w < arr.touched.size(); ++w) {
+      quint64 bits = arr.touched[w] & arr.useMask[w];
+      arr.touched[w] = 0;
+      for (; bits; bits &= bits - 1) {
+        int i = w * 64 + adtCountTrailingZeros(bits);
+        if (arr.stamps[i] != arr.sampleStamps[i]) {
+          arr.sampleStamps[i] = arr.stamps[i];
+          if (show)
+            arr.temporal.add(i, arr.stamps[i], arr.vals[i]);
+          RobustStats &rs = arr.robust[i];
+          rs.add(arr.vals[i]);
+          arr.arrayRobust.add(arr.vals[i]);
+          arr.bandLo[i] = rs.low();
+          arr.bandHi[i] = rs.high();
+        }
+        if (show)
+          arr.temporalVals[i] = arr.temporal.value(i, temporalMode);
+        if (windowed) {
+          arr.envelope.add(i, now, arr.vals[i]);
+          arr.winMin[i] = arr.envelope.min(i);
+          arr.winMax[i] = arr.envelope.max(i);
+          arr.nextEnvelope = std::min(arr.nextEnvelope, arr.envelope.due(i) + envelopeWindow);
+        }
+      }
     }
-    for (auto aw : areaWidgets)
-      aw->refresh();
+  }
+
+  /**
+   * @brief Age old samples out of the windowed Max/Min.
+   *
+   * An array is only scanned once its oldest entry is due, and then no
+   * sooner than 1/ENVELOPE_STEPS of the window after the last scan, so
+   * the envelope may trail by that much.
+   */
+  void updateEnvelopes()
+  {
+    if (envelopeWindow <= 0.0)
+      return;
+    double now = QDateTime::currentMSecsSinceEpoch() / 1000.0;
+    double cutoff = now - envelopeWindow;
     for (ArrayData &arr : arrays) {
+      if (now < arr.nextEnvelope)
+        continue;
+      double next = LARGEVAL;
+      bool changed = false;
       for (int i = 0; i < arr.nvals; ++i) {
-        if (arr.chids[i] && ca_state(arr.chids[i]) == cs_conn)
-          ca_array_get_callback(DBR_DOUBLE, 1, arr.chids[i], getCallback,
-            &arr.cbData[i]);
+        if (arr.envelope.expire(i, cutoff)) {
+          arr.winMin[i] = arr.envelope.min(i);
+          arr.winMax[i] = arr.envelope.max(i);
+          changed = true;
+        }
+        next = std::min(next, arr.envelope.due(i) + envelopeWindow);
       }
+      arr.nextEnvelope = std::max(next, now + envelopeWindow / ENVELOPE_STEPS);
+      if (changed)
+        arr.dirty = true;
     }
-    ca_flush_io();
   }
 
-  void showStatus()
+  /**
+   * @brief Empty the quantile sketches of @p arr.
+   */
+  static void resetRobust(ArrayData &arr)
   {
-    time_t now = std::time(nullptr);
-    char tbuf[26];
-    std::strncpy(tbuf, std::ctime(&now), 24);
-    tbuf[24] = '\0';
+    arr.robust.fill(RobustStats(), arr.nvals);
+    arr.arrayRobust = RobustStats();
+    arr.bandLo.fill(LARGEVAL, arr.nvals);
+    arr.bandHi.fill(-LARGEVAL, arr.nvals);
+    arr.sampleStamps.fill(-1.0, arr.nvals);
+  }
 
-    QString msg;
-    msg += QString::asprintf("Time:         %s\n", tbuf);
-    msg += QString::asprintf("PV file:      %s\n", pvFilename.toUtf8().constData());
-    msg += QString::asprintf("Lattice file: %s\n", latFilename.toUtf8().constData());
+  /**
+   * @brief Restart the windowed Max/Min of @p arr from the values that
+   * count in the statistics now.
+   */
+  static void resetEnvelope(ArrayData &arr)
+  {
+    bool windowed = envelopeWindow > 0.0;
+    arr.envelope.reset(windowed ? arr.nvals : 0, envelopeWindow);
+    arr.winMin.fill(LARGEVAL, arr.nvals);
+    arr.winMax.fill(-LARGEVAL, arr.nvals);
+    arr.nextEnvelope = LARGEVAL;
+    if (!windowed || arr.useMask.size() * 64 < arr.nvals)
+      return;
+    double now = QDateTime::currentMSecsSinceEpoch() / 1000.0;
+    for (int i = 0; i < arr.nvals; ++i) {
+      if (!maskBit(arr.useMask, i))
+        continue;
+      arr.envelope.add(i, now, arr.vals[i]);
+      arr.winMin[i] = arr.envelope.min(i);
+      arr.winMax[i] = arr.envelope.max(i);
+    }
+  }
+
+  /**
+   * @brief Fill the displayed temporal statistic of every element of @p arr.
+   */
+  void refreshTemporal(ArrayData &arr)
+  {
+    arr.temporalVals.fill(0.0, arr.nvals);
+    if (temporalMode == TEMPORAL_OFF)
+      return;
+    for (int i = 0; i < arr.nvals; ++i)
+      arr.temporalVals[i] = arr.temporal.value(i, temporalMode);
+  }
+
+  /**
+   * @brief Empty the temporal windows of all arrays, sized to temporalWindow
+   * while a temporal mode is on and released while it is off.
+   */
+  void resetTemporal()
+  {
+    double now = QDateTime::currentMSecsSinceEpoch() / 1000.0;
+    for (ArrayData &arr : arrays) {
+      arr.temporal.reset(temporalMode != TEMPORAL_OFF ? arr.nvals : 0, temporalWindow, now);
+      arr.temporalVals.fill(0.0, arr.nvals);
+    }
+  }
+
+  /**
+   * @brief Repaint the areas showing dirty arrays and clear the flags.
+   */
+  void refreshDirtyAreas(bool all = false)
+  {
+    for (auto aw : areaWidgets) {
+      if (all || aw->hasDirtyArrays() || aw->refreshPending())
+        aw->refresh();
+    }
+    for (ArrayData &arr : arrays)
+      arr.dirty = false;
+  }
+
+  /**
+   * @brief Count connected and total channels over all arrays.
+   */
+  void countConnections(int &nconnected, int &nchannels) const
+  {
+    nconnected = 0;
+    nchannels = 0;
+    for (const ArrayData &arr : arrays) {
+      nconnected += arr.nconn;
+      nchannels += arr.nvals;
+    }
+  }
+
+  /**
+   * @brief Show connection progress in the window title.
+   */
+  void updateConnectProgress()
+  {
+    if (pvFilename.isEmpty())
+      return;
+    if (restoreTimer->isActive()) {
+      AcqRestoreStatus st = engine.restoreStatus();
+      setWindowTitle(QString("ADT - %1 (restoring %2/%3)")
+        .arg(QFileInfo(pvFilename).fileName())
+        .arg(st.done + st.failed).arg(st.total));
+      return;
+    }
+    int nconnected, nchannels;
+    countConnections(nconnected, nchannels);
+    QString title = "ADT - " + QFileInfo(pvFilename).fileName();
+    if (stormActive()) {
+      setWindowTitle(title + QString(" (reconnecting: %1 dropped, %2 still down)")
+        .arg(stormDrops).arg(nchannels - nconnected));
+      return;
+    }
+    int nsearch = engine.searchesPending();
+    if (nsearch > 0)
+      title += QString(" (%1/%2 connected, %3 to search)")
+        .arg(nconnected).arg(nchannels).arg(nsearch);
+    else if (nconnected < nchannels)
+      title += QString(" (%1/%2 connected)").arg(nconnected).arg(nchannels);
+    setWindowTitle(title);
+  }
+
+  /**
+   * @brief Fast poll used while channels are still connecting.
+   *
+   * Lets connections and first values appear without waiting for the
+   * regular update interval. Stops once everything is connected or
+   * nothing has changed for a few seconds; the regular tick keeps the
+   * progress current after that.
+   */
+  void pollConnections()
+  {
+    if (!acquiring) {
+      connectTimer->stop();
+      return;
+    }
+    updateVisibility();
+    pullFrames();
+    updateStale();
+    updateEnvelopes();
+    updateDirtyStats();
+    refreshTick();
+    updateConnectProgress();
+    int nconnected, nchannels;
+    countConnections(nconnected, nchannels);
+    if (nconnected != lastConnected) {
+      lastConnected = nconnected;
+      connectIdleTicks = 0;
+    } else {
+      ++connectIdleTicks;
+    }
+    if (engine.searchesPending() > 0)
+      connectIdleTicks = 0;
+    if (nconnected >= nchannels || connectIdleTicks > 50)
+      connectTimer->stop();
+  }
+
+  /**
+   * @brief Copy the latest acquired frame of each array in a rate group.
+   *
+   * @p group is an array interval in ms, 0 for the arrays that follow the
+   * global interval, or -1 for every array. Arrays the acquisition thread
+   * has not written since the last copy are skipped and stay clean.
+   */
+  void pullFrames(int group = -1)
+  {
+    int ndrops = 0;
+    for (int ia = 0; ia < arrays.size(); ++ia) {
+      ArrayData &arr = arrays[ia];
+      if (group >= 0 && arr.interval != group)
+        continue;
+      AcqFrame frame;
+      frame.vals = arr.vals.data();
+      frame.conn = arr.conn.data();
+      frame.stamps = arr.stamps.data();
+      frame.arrivals = arr.arrivals.data();
+      frame.severity = arr.severity.data();
+      frame.validity = arr.validity.data();
+      frame.changed = reinterpret_cast<uint64_t *>(arr.touched.data());
+      if (engine.read(ia, frame, arr.frameSeq))
+        arr.dirty = true;
+      arr.nconn = engine.connected(ia);
+      unsigned drops = engine.drops(ia);
+      ndrops += (int)(drops - arr.drops);
+      arr.drops = drops;
+    }
+    trackStorm(ndrops);
+  }
+
+  /**
+   * @brief Follow a burst of disconnects, such as an IOC reboot.
+   *
+   * Drops and reconnects that come within STORM_QUIET of each other form
+   * one episode. Once STORM_CHANNELS have dropped it is a storm: the
+   * title carries a one-line summary and repaints are coalesced. A
+   * reconnected channel stays out of the statistics and min/max until
+   * its first new value, which the engine sees to. When the episode
+   * goes quiet a storm leaves one line on stderr.
+   */
+  void trackStorm(int ndrops)
+  {
+    double now = QDateTime::currentMSecsSinceEpoch() / 1000.0;
+    int nconnected, nchannels;
+    countConnections(nconnected, nchannels);
+    if (ndrops > 0) {
+      if (stormDrops == 0)
+        stormStart = now;
+      stormDrops += ndrops;
+      stormLast = now;
+    } else if (stormDrops > 0 && nconnected != stormConnected) {
+      stormLast = now;
+    }
+    stormConnected = nconnected;
+    if (stormDrops == 0 || now - stormLast < STORM_QUIET)
+      return;
+    if (stormActive()) {
+      QString from = QDateTime::fromMSecsSinceEpoch((qint64)(stormStart * 1000)).toString("hh:mm:ss");
+      QString to = QDateTime::fromMSecsSinceEpoch((qint64)(stormLast * 1000)).toString("hh:mm:ss");
+      if (nconnected < nchannels)
+        fprintf(stderr, "ADT: %d channels dropped between %s and %s, %d still disconnected\n",
+                stormDrops, from.toLatin1().constData(), to.toLatin1().constData(),
+                nchannels - nconnected);
+      else
+        fprintf(stderr, "ADT: %d channels dropped between %s and %s, all reconnected\n",
+                stormDrops, from.toLatin1().constData(), to.toLatin1().constData());
+    }
+    stormDrops = 0;
+  }
+
+  bool stormActive() const
+  {
+    return stormDrops >= STORM_CHANNELS;
+  }
+
+  /**
+   * @brief Repaint dirty areas from a timer tick.
+   *
+   * During a storm every tick brings a few more reconnects, so repaints
+   * are held to one per STORM_PAINT_MS; arrays stay dirty until then.
+   */
+  void refreshTick()
+  {
+    if (stormActive()) {
+      qint64 now = QDateTime::currentMSecsSinceEpoch();
+      if (now - stormPainted < STORM_PAINT_MS)
+        return;
+      stormPainted = now;
+    }
+    refreshDirtyAreas();
+  }
+
+  /**
+   * @brief Flag connected elements that have received nothing for
+   * staleTime.
+   *
+   * Ages run from when a value or heartbeat reply arrived here, not from
+   * the IOC time stamp, so a clock offset between hosts does not matter.
+   * A tick looks only at the elements just copied and at the queue
+   * entries that came due, so its cost follows the updates rather than
+   * the array size.
+   */
+  void updateStale()
+  {
+    double now = QDateTime::currentMSecsSinceEpoch() / 1000.0;
+    for (ArrayData &arr : arrays) {
+      if (staleTime <= 0.0) {
+        if (arr.nstale > 0) {
+          arr.stale.fill(false);
+          arr.nstale = 0;
+          arr.dirty = true;
+          arr.statsFull = true;
+        }
+        arr.staleDue.clear();
+        continue;
+      }
+      bool changed = false;
+      if (arr.staleRescan) {
+        arr.staleDue.clear();
+        arr.staleQueued.fill(false, arr.nvals);
+        for (int i = 0; i < arr.nvals; ++i)
+          changed |= checkStale(arr, i, now);
+        arr.staleRescan = false;
+      } else if (arr.dirty) {
+        for (int w = 0; w < arr.touched.size(); ++w) {
+          for (quint64 bits = arr.touched[w]; bits; bits &= bits - 1)
+            changed |= checkStale(arr, w * 64 + adtCountTrailingZeros(bits), now);
+        }
+      }
+      std::greater<std::pair<double, int>> later;
+      while (!arr.staleDue.empty() && arr.staleDue.front().first <= now) {
+        int i = arr.staleDue.front().second;
+        std::pop_heap(arr.staleDue.begin(), arr.staleDue.end(), later);
+        arr.staleDue.pop_back();
+        arr.staleQueued[i] = false;
+        changed |= checkStale(arr, i, now);
+      }
+      if (changed)
+        arr.dirty = true;
+    }
+  }
+
+  /**
+   * @brief Recheck whether element @p i of @p arr is stale, and queue it
+   * for when it is due if it is fresh and not queued yet. An entry that
+   * comes due after a newer arrival is simply queued again. Returns
+   * whether the flag changed.
+   */
+  static bool checkStale(ArrayData &arr, int i, double now)
+  {
+    bool stale = false;
+    if (arr.conn[i]) {
+      double due = arr.arrivals[i] + staleTime;
+      stale = now >= due;
+      if (!stale && !arr.staleQueued[i]) {
+        arr.staleDue.push_back(std::make_pair(due, i));
+        std::push_heap(arr.staleDue.begin(), arr.staleDue.end(),
+                       std::greater<std::pair<double, int>>());
+        arr.staleQueued[i] = true;
+      }
+    }
+    if (stale == arr.stale[i])
+      return false;
+    arr.stale[i] = stale;
+    arr.nstale += stale ? 1 : -1;
+    arr.touched[i >> 6] |= quint64(1) << (i & 63);
+    return true;
+  }
+
+  /**
+   * @brief Timer tick of one rate group: take the latest frames, then
+   * update stats and plots.
+   *
+   * Values are acquired on the engine thread, so the tick only copies the
+   * group's arrays that changed, recomputes their statistics and repaints
+   * the areas showing them. Group 0 is the global update interval.
+   */
+  void pollPvUpdate(int group)
+  {
+    if (!acquiring)
+      return;
+    if (group == 0)
+      updateVisibility();
+    pullFrames(group);
+    updateStale();
+    updateEnvelopes();
+    updateDirtyStats();
+    if (group == 0) {
+      nstat += 1.0;
+      nstatTime += timeInterval;
+    }
+    for (ArrayData &arr : arrays) {
+      if (arr.interval != group || !arr.shown)
+        continue;
+      arr.runN += 1.0;
+      arr.runSdev += arr.sdev;
+      arr.runAvg += arr.avg;
+      if (std::fabs(arr.maxVal) > std::fabs(arr.runMax))
+        arr.runMax = arr.maxVal;
+      if (statMode)
+        arr.dirty = true;
+    }
+    refreshTick();
+    if (group == 0)
+      updateConnectProgress();
+  }
+
+  /**
+   * @brief Tell the engine which arrays are on screen.
+   *
+   * An array is shown while any area widget displaying it is exposed.
+   * Channels of hidden arrays are paused, and catch up with one update
+   * when they are shown again. Covered windows are only noticed where
+   * the window system reports them, so this is rechecked every tick.
+   */
+  void updateVisibility()
+  {
+    if (!acquiring)
+      return;
+    std::vector<bool> shown(arrays.size(), false);
+    for (auto aw : areaWidgets) {
+      if (!aw->exposed())
+        continue;
+      for (ArrayData *arr : aw->arrays())
+        shown[arr->index] = true;
+    }
+    bool changed = false;
+    for (int ia = 0; ia < arrays.size(); ++ia) {
+      if (arrays[ia].shown != shown[ia]) {
+        arrays[ia].shown = shown[ia];
+        changed = true;
+      }
+    }
+    if (changed)
+      engine.setVisible(shown);
+  }
+
+  /**
+   * @brief Start one timer per distinct array interval.
+   *
+   * Arrays without an interval of their own are served by pollTimer.
+   */
+  void startRateTimers()
+  {
+    stopRateTimers();
+    for (const ArrayData &arr : arrays) {
+      if (arr.interval <= 0 || rateTimers.contains(arr.interval))
+        continue;
+      int group = arr.interval;
+      QTimer *timer = new QTimer(this);
+      connect(timer, &QTimer::timeout, this, [this, group]() { pollPvUpdate(group); });
+      timer->start(group);
+      rateTimers.insert(group, timer);
+    }
+  }
+
+  void stopRateTimers()
+  {
+    for (QTimer *timer : rateTimers) {
+      timer->stop();
+      timer->deleteLater();
+    }
+    rateTimers.clear();
+  }
+
+  void showStatus()
+  {
+    time_t now = std::time(nullptr);
+    char tbuf[26];
+    std::strncpy(tbuf, std::ctime(&now), 24);
+    tbuf[24] = '\0';
+
+    QString msg;
+    msg += QString::asprintf("Time:         %s\n", tbuf);
+    msg += QString::asprintf("PV file:      %s\n", pvFilename.toUtf8().constData());
+    msg += QString::asprintf("Lattice file: %s\n", latFilename.toUtf8().constData());
     msg += QString::asprintf("Reference file: %s\n\n", refFilename.toUtf8().constData());
     msg += QString::asprintf(
       "Accumulated History Time (min): %.1f    Nsymbols=%d\n",
@@ -2460,16 +3602,41 @@ private:
     for (const ArrayData &arr : arrays) {
       msg += QString::asprintf("%5d %5d % 7.3f % 7.3f %7.3f\n",
         arr.index + 1, arr.nvals,
-        nstat > 0 ? arr.runSdev / nstat : 0.0,
-        nstat > 0 ? arr.runAvg / nstat : 0.0,
+        arr.runN > 0 ? arr.runSdev / arr.runN : 0.0,
+        arr.runN > 0 ? arr.runAvg / arr.runN : 0.0,
         arr.runMax);
     }
-    msg += "\nSlot  Time                      File\n";
+    msg += "\nSlot  Time                      Spread(s)  File\n";
     for (int i = 0; i < NSAVE; ++i) {
       QByteArray st = saveTime[i].toUtf8();
       QByteArray sf = saveFilename[i].toUtf8();
-      msg += QString::asprintf("%3d   %.24s  %s\n", i + 1,
-        st.constData(), sf.constData());
+      QString spread = saveStampMax[i] > 0.0 ?
+        QString::number(saveStampMax[i] - saveStampMin[i], 'f', 3) : "-";
+      msg += QString::asprintf("%3d   %-24.24s  %9s  %s\n", i + 1,
+        st.constData(), spread.toUtf8().constData(), sf.constData());
+    }
+
+    // Worst IOCs first: least connected, then longest silent
+    std::vector<AcqIocHealth> iocs = engine.iocHealth();
+    std::sort(iocs.begin(), iocs.end(), [](const AcqIocHealth &a, const AcqIocHealth &b) {
+      double fa = (double)a.connected / a.channels, fb = (double)b.connected / b.channels;
+      if (fa != fb)
+        return fa < fb;
+      return a.age > b.age;
+    });
+    if (!iocs.empty()) {
+      msg += "\nIOC                          Chans  Conn%   Upd/s  Age(s)  Lat(ms)  Reconn\n";
+      for (size_t i = 0; i < iocs.size() && i < STATUS_IOC_ROWS; ++i) {
+        const AcqIocHealth &h = iocs[i];
+        msg += QString::asprintf("%-28.28s %6d %6.1f %7.1f %7s %8.1f %7u\n",
+          h.host.empty() ? "(never connected)" : h.host.c_str(), h.channels,
+          100.0 * h.connected / h.channels, h.rate,
+          h.age < 0.0 ? "-" : QString::number(h.age, 'f', 1).toUtf8().constData(),
+          1000.0 * h.latency, h.reconnects);
+      }
+      if (iocs.size() > STATUS_IOC_ROWS)
+        msg += QString::asprintf("... %d more IOCs, use Save IOC Health to see all\n",
+          (int)(iocs.size() - STATUS_IOC_ROWS));
     }
 
     QDialog dlg(this);
@@ -2481,11 +3648,57 @@ private:
     label.setTextInteractionFlags(Qt::TextSelectableByMouse);
     layout.addWidget(&label);
     QDialogButtonBox buttons(QDialogButtonBox::Ok);
+    QPushButton *saveHealth = buttons.addButton("Save IOC Health...",
+      QDialogButtonBox::ActionRole);
+    saveHealth->setEnabled(!iocs.empty());
+    connect(saveHealth, &QPushButton::clicked, &dlg, [this, &dlg, &iocs]() {
+      QString fn = QFileDialog::getSaveFileName(&dlg, "Write IOC Health File",
+        QDir::currentPath(), "SDDS Files (*.sdds)");
+      if (fn.isEmpty())
+        return;
+      if (!writeIocHealthFile(fn, iocs))
+        QMessageBox::warning(&dlg, "ADT", QString("Unable to write %1").arg(fn));
+    });
     connect(&buttons, &QDialogButtonBox::accepted, &dlg, &QDialog::accept);
     layout.addWidget(&buttons);
     dlg.exec();
   }
 
+  /**
+   * Write per-IOC channel health as an SDDS table, one row per IOC.
+   */
+  bool writeIocHealthFile(const QString &filename, const std::vector<AcqIocHealth> &iocs)
+  {
+    FILE *file = fopen(filename.toUtf8().constData(), "w");
+    if (!file)
+      return false;
+    time_t now = std::time(nullptr);
+    char tbuf[26];
+    std::strncpy(tbuf, std::ctime(&now), 24);
+    tbuf[24] = '\0';
+
+    fprintf(file, "%s\n", SDDSID);
+    fprintf(file, "&description text=\"ADT IOC Health from %s\" &end\n",
+      pvFilename.toUtf8().constData());
+    fprintf(file,
+      "&parameter name=TimeStamp fixed_value=\"%s\" type=string &end\n", tbuf);
+    fprintf(file, "&column name=IOC type=string &end\n");
+    fprintf(file, "&column name=Channels type=long &end\n");
+    fprintf(file, "&column name=Connected type=long &end\n");
+    fprintf(file, "&column name=ConnectedFraction type=double &end\n");
+    fprintf(file, "&column name=UpdateRate type=double units=1/s &end\n");
+    fprintf(file, "&column name=LastUpdateAge type=double units=s &end\n");
+    fprintf(file, "&column name=Latency type=double units=s &end\n");
+    fprintf(file, "&column name=Reconnects type=long &end\n");
+    fprintf(file, "&data mode=ascii no_row_counts=1 &end\n");
+    for (const AcqIocHealth &h : iocs) {
+      fprintf(file, "\"%s\" %d %d %f %f %f %f %u\n", h.host.c_str(), h.channels,
+        h.connected, (double)h.connected / h.channels, h.rate, h.age, h.latency,
+        h.reconnects);
+    }
+    return fclose(file) == 0;
+  }
+
   bool writePlotFile(const QString &filename, int nsave = -1)
   {
     FILE *file = fopen(filename.toUtf8().constData(), "w");
@@ -2528,6 +3741,14 @@ private:
     fprintf(file, "&column name=Index type=short &end\n");
     fprintf(file, "&column name=ControlName type=string &end\n");
     fprintf(file, "&column name=Value type=double &end\n");
+    if (checkStatus) {
+      fprintf(file, "&column name=StatusName type=string &end\n");
+      fprintf(file, "&column name=Status type=string &end\n");
+    }
+    if (checkThreshold) {
+      fprintf(file, "&column name=ThresholdName type=string &end\n");
+      fprintf(file, "&column name=Threshold type=string &end\n");
+    }
     fprintf(file,
       "&data mode=ascii no_row_counts=1 additional_header_lines=1 &end\n");
     for (const ArrayData &arr : arrays) {
@@ -2550,8 +3771,19 @@ private:
         arr.units.toUtf8().constData());
       fprintf(file, "%d     !ADTDisplayArea\n", arr.area->index + 1);
       for (int i = 0; i < arr.nvals; ++i) {
-        fprintf(file, "%d %s % f\n", i + 1,
+        fprintf(file, "%d %s % f", i + 1,
           arr.names[i].toUtf8().constData(), (*vals)[i]);
+        if (checkStatus) {
+          QString name = i < arr.statusNames.size() ? arr.statusNames[i] : QString("-");
+          fprintf(file, " %s %s", name.isEmpty() ? "-" : name.toUtf8().constData(),
+            validityText(name, arr.conn[i], arr.validity[i]));
+        }
+        if (checkThreshold) {
+          QString name = i < arr.thresholdNames.size() ? arr.thresholdNames[i] : QString("-");
+          fprintf(file, " %s %s", name.isEmpty() ? "-" : name.toUtf8().constData(),
+            validityText(name, arr.conn[i], arr.validity[i] >> ACQ_THRESHOLD_SHIFT));
+        }
+        fprintf(file, "\n");
       }
     }
     fclose(file);
@@ -2697,6 +3929,16 @@ private:
         } else {
           saveTime[nsave].clear();
         }
+        double start = 0.0, spread = 0.0;
+        if (SDDS_GetParameterIndex(&table, const_cast<char *>("ValueTimeStart")) >= 0 &&
+            SDDS_GetParameterIndex(&table, const_cast<char *>("ValueTimeSpread")) >= 0 &&
+            SDDS_GetParameterAsDouble(&table, const_cast<char *>("ValueTimeStart"), &start) &&
+            SDDS_GetParameterAsDouble(&table, const_cast<char *>("ValueTimeSpread"), &spread)) {
+          saveStampMin[nsave] = start;
+          saveStampMax[nsave] = start + spread;
+        } else {
+          saveStampMin[nsave] = saveStampMax[nsave] = 0.0;
+        }
       }
       int nvals = SDDS_CountRowsOfInterest(&table);
       if (nvals != arrays[ia].nvals) {
@@ -2738,6 +3980,7 @@ private:
         }
         arrays[ia].saveVals[nsave][i] = atof(rawvalues[i]);
       }
+      arrays[ia].saveConn[nsave] = snapConnected(&table, nvals);
       freeSddsStrings(nvals, rawnames);
       freeSddsStrings(nvals, rawvalues);
     }
@@ -2777,10 +4020,13 @@ private:
     }
 
     char tbuf[26];
+    double tmin = 0.0, tmax = 0.0;
     if (nsave < 0) {
       time_t clock = std::time(nullptr);
       std::strncpy(tbuf, std::ctime(&clock), 24);
       tbuf[24] = '\0';
+      if (!stampRange(tmin, tmax))
+        tmin = tmax = 0.0;
     } else {
       if (nsave >= NSAVE || saveTime[nsave].isEmpty()) {
         fclose(file);
@@ -2791,6 +4037,8 @@ private:
       QByteArray st = saveTime[nsave].toUtf8();
       std::strncpy(tbuf, st.constData(), 24);
       tbuf[24] = '\0';
+      tmin = saveStampMin[nsave];
+      tmax = saveStampMax[nsave];
     }
 
     fprintf(file, "%s\n", SDDSID);
@@ -2805,18 +4053,29 @@ private:
       tbuf);
     fprintf(file,
       "&parameter name=SnapType fixed_value=\"Absolute\" type=string &end\n");
+    if (tmax > 0.0) {
+      fprintf(file,
+        "&parameter name=ValueTimeStart fixed_value=%.6f type=double &end\n",
+        tmin);
+      fprintf(file,
+        "&parameter name=ValueTimeSpread fixed_value=%.6f type=double &end\n",
+        tmax - tmin);
+    }
     fprintf(file, "&parameter name=Heading type=string &end\n");
     fprintf(file, "&column name=ControlName type=string &end\n");
     fprintf(file, "&column name=ControlType type=string &end\n");
     fprintf(file, "&column name=Lineage type=string &end\n");
     fprintf(file, "&column name=Count type=long &end\n");
     fprintf(file, "&column name=ValueString type=string &end\n");
+    fprintf(file, "&column name=Connected type=short &end\n");
     fprintf(file,
       "&data mode=ascii no_row_counts=1 additional_header_lines=1 &end\n");
     for (const ArrayData &arr : arrays) {
       const QVector<double> *vals = nullptr;
+      const QVector<bool> *conn = nullptr;
       if (nsave < 0) {
         vals = &arr.vals;
+        conn = &arr.conn;
       } else {
         if (arr.saveVals[nsave].size() != arr.nvals) {
           fclose(file);
@@ -2825,19 +4084,277 @@ private:
           return false;
         }
         vals = &arr.saveVals[nsave];
+        if (arr.saveConn[nsave].size() == arr.nvals)
+          conn = &arr.saveConn[nsave];
       }
       fprintf(file, "\n");
       fprintf(file, "%s (%s)\n", arr.heading.toUtf8().constData(),
         arr.units.toUtf8().constData());
+      // Connected is 0 for a PV that was not connected, so Restore skips it
       for (int i = 0; i < arr.nvals; ++i) {
-        fprintf(file, "%s pv - 1 %f\n",
-          arr.names[i].toUtf8().constData(), (*vals)[i]);
+        fprintf(file, "%s pv - 1 %f %d\n",
+          arr.names[i].toUtf8().constData(), (*vals)[i], !conn || (*conn)[i] ? 1 : 0);
       }
     }
     fclose(file);
     return true;
   }
 
+  /**
+   * @brief Whether each of the @p nvals rows of the current snapshot page
+   * was connected when it was stored, from the Connected column ADT
+   * writes. Files without it, such as BURT snapshots, count as all
+   * connected.
+   */
+  static QVector<bool> snapConnected(SDDS_TABLE *table, int nvals)
+  {
+    QVector<bool> conn;
+    conn.fill(true, nvals);
+    if (SDDS_CheckColumn(table, const_cast<char *>("Connected"), NULL,
+                         SDDS_ANY_INTEGER_TYPE, NULL) != SDDS_CHECK_OKAY)
+      return conn;
+    int32_t *flag = (int32_t *)SDDS_GetColumnInLong(table, const_cast<char *>("Connected"));
+    if (flag) {
+      for (int i = 0; i < nvals; ++i)
+        conn[i] = flag[i] != 0;
+      SDDS_Free(flag);
+    }
+    return conn;
+  }
+
+  /**
+   * @brief Write a stored set back to the PVs it was taken from.
+   *
+   * Arrays filled from a waveform are skipped, since their names are
+   * only labels, and so are elements that were not connected when the
+   * set was stored. Only arrays flagged ADTRestore are selected at first.
+   */
+  void restoreSaved(int n)
+  {
+    if (arrays.isEmpty()) {
+      QMessageBox::warning(this, "ADT", "There are no PV's defined");
+      return;
+    }
+    if (n < 1 || n > NSAVE)
+      return;
+    int idx = n - 1;
+    QVector<RestorePage> pages;
+    for (const ArrayData &arr : arrays) {
+      if (arr.saveVals[idx].size() != arr.nvals) {
+        QMessageBox::warning(this, "ADT",
+          QString("Data is not defined for set %1").arg(n));
+        return;
+      }
+      if (!arr.waveform.isEmpty())
+        continue;
+      RestorePage page;
+      page.label = arr.heading;
+      page.chosen = arr.restore;
+      bool haveConn = arr.saveConn[idx].size() == arr.nvals;
+      for (int i = 0; i < arr.nvals; ++i) {
+        if (haveConn && !arr.saveConn[idx][i]) {
+          ++page.skipped;
+          continue;
+        }
+        AcqPut put;
+        put.name = arr.names[i].toStdString();
+        if (arr.sim && !arr.names[i].contains("://"))
+          put.name = "sim://" + put.name;
+        else if (arr.pva && !arr.names[i].contains("://"))
+          put.name = "pva://" + put.name;
+        put.value = arr.saveVals[idx][i];
+        page.puts.push_back(put);
+      }
+      pages.append(page);
+    }
+    startRestore(pages, QString("set %1").arg(n));
+  }
+
+  /**
+   * @brief Write the PVs of a snapshot file back to the machine.
+   *
+   * The file need not match the loaded PV file. Each page is offered on
+   * its own, selected at first if it has the heading of a loaded array
+   * flagged ADTRestore; rows stored while not connected are skipped.
+   */
+  void restoreFile()
+  {
+    QString dir = snapDirectory.isEmpty() ? QDir::currentPath() : snapDirectory;
+    QString fn = QFileDialog::getOpenFileName(this, "Restore Snapshot File",
+      dir, "Snapshot Files (*.snap)");
+    if (fn.isEmpty())
+      return;
+    snapDirectory = QFileInfo(fn).absolutePath();
+
+    SDDS_TABLE table;
+    QByteArray fname = fn.toUtf8();
+    SDDS_ClearErrors();
+    if (!SDDS_InitializeInput(&table, fname.data())) {
+      QMessageBox::warning(this, "ADT", QString("Unable to read %1").arg(fn));
+      if (SDDS_NumberOfErrors())
+        SDDS_PrintErrors(stderr, SDDS_VERBOSE_PrintErrors);
+      return;
+    }
+    if (SDDS_CheckColumn(&table, const_cast<char *>("ControlName"), NULL,
+        SDDS_STRING, NULL) != SDDS_CHECK_OKAY ||
+        SDDS_CheckColumn(&table, const_cast<char *>("ValueString"), NULL,
+        SDDS_STRING, NULL) != SDDS_CHECK_OKAY) {
+      QMessageBox::warning(this, "ADT",
+        "Missing required columns in snapshot file");
+      SDDS_Terminate(&table);
+      return;
+    }
+    QVector<RestorePage> pages;
+    bool first = true;
+    while (SDDS_ReadTable(&table) > 0) {
+      if (first) {
+        char *type = nullptr;
+        if (!SDDS_GetParameter(&table, const_cast<char *>("ADTFileType"),
+            &type) || strcmp(type, SNAPID)) {
+          QMessageBox::warning(this, "ADT",
+            QString("Not a valid ADT Reference/Snapshot file: %1").arg(fn));
+          SDDS_Free(type);
+          SDDS_Terminate(&table);
+          return;
+        }
+        SDDS_Free(type);
+        first = false;
+      }
+      int nvals = SDDS_CountRowsOfInterest(&table);
+      if (nvals <= 0)
+        continue;
+      char **rawnames = (char **)SDDS_GetColumn(&table,
+        const_cast<char *>("ControlName"));
+      char **rawvalues = (char **)SDDS_GetColumn(&table,
+        const_cast<char *>("ValueString"));
+      RestorePage page;
+      char *heading = nullptr;
+      if (SDDS_GetParameter(&table, const_cast<char *>("Heading"), &heading) && heading)
+        page.label = QString::fromUtf8(heading).trimmed();
+      SDDS_Free(heading);
+      if (page.label.isEmpty())
+        page.label = QString("Page %1").arg(pages.size() + 1);
+      for (const ArrayData &arr : arrays) {
+        if (arr.restore && page.label == QString("%1 (%2)").arg(arr.heading).arg(arr.units))
+          page.chosen = true;
+      }
+      if (rawnames && rawvalues) {
+        QVector<bool> conn = snapConnected(&table, nvals);
+        for (int i = 0; i < nvals; ++i) {
+          if (!conn[i]) {
+            ++page.skipped;
+            continue;
+          }
+          AcqPut put;
+          put.name = rawnames[i];
+          put.value = atof(rawvalues[i]);
+          page.puts.push_back(put);
+        }
+      }
+      pages.append(page);
+      if (rawnames)
+        freeSddsStrings(nvals, rawnames);
+      if (rawvalues)
+        freeSddsStrings(nvals, rawvalues);
+    }
+    SDDS_Terminate(&table);
+    startRestore(pages, QFileInfo(fn).fileName());
+  }
+
+  /**
+   * @brief Let the user confirm which of @p pages to write. Returns false
+   * if the restore is cancelled.
+   */
+  bool chooseRestore(QVector<RestorePage> &pages, const QString &source)
+  {
+    QDialog dlg(this);
+    dlg.setWindowTitle("Restore to Machine");
+    QVBoxLayout layout(&dlg);
+    QLabel label(QString("Write the checked arrays from %1 to the machine:").arg(source));
+    layout.addWidget(&label);
+    QVector<QCheckBox *> boxes;
+    for (const RestorePage &page : pages) {
+      QString text = QString("%1 (%2 PVs").arg(page.label).arg(page.puts.size());
+      if (page.skipped > 0)
+        text += QString(", %1 not connected when stored").arg(page.skipped);
+      QCheckBox *box = new QCheckBox(text + ")", &dlg);
+      box->setChecked(page.chosen && !page.puts.empty());
+      box->setEnabled(!page.puts.empty());
+      layout.addWidget(box);
+      boxes.append(box);
+    }
+    QDialogButtonBox buttons(QDialogButtonBox::Ok | QDialogButtonBox::Cancel);
+    connect(&buttons, &QDialogButtonBox::accepted, &dlg, &QDialog::accept);
+    connect(&buttons, &QDialogButtonBox::rejected, &dlg, &QDialog::reject);
+    layout.addWidget(&buttons);
+    if (dlg.exec() != QDialog::Accepted)
+      return false;
+    for (int k = 0; k < pages.size(); ++k)
+      pages[k].chosen = boxes[k]->isChecked();
+    return true;
+  }
+
+  /**
+   * @brief Confirm a restore and hand the chosen pages to the engine.
+   */
+  void startRestore(QVector<RestorePage> &pages, const QString &source)
+  {
+    if (pages.isEmpty()) {
+      QMessageBox::warning(this, "ADT", "There are no PV's to restore");
+      return;
+    }
+    if (!chooseRestore(pages, source))
+      return;
+    std::vector<AcqPut> puts;
+    for (const RestorePage &page : pages) {
+      if (page.chosen)
+        puts.insert(puts.end(), page.puts.begin(), page.puts.end());
+    }
+    if (puts.empty()) {
+      QMessageBox::warning(this, "ADT", "There are no PV's to restore");
+      return;
+    }
+    if (!engine.running() && !engine.start()) {
+      QMessageBox::warning(this, "ADT", "Unable to start Channel Access");
+      return;
+    }
+    if (!engine.restore(puts)) {
+      QMessageBox::warning(this, "ADT", "A restore is already in progress");
+      return;
+    }
+    restoreSource = source;
+    restoreTimer->start(200);
+    updateConnectProgress();
+  }
+
+  /**
+   * @brief Follow a running restore and report the result when it ends.
+   */
+  void pollRestore()
+  {
+    AcqRestoreStatus st = engine.restoreStatus();
+    if (st.active) {
+      updateConnectProgress();
+      return;
+    }
+    restoreTimer->stop();
+    updateConnectProgress();
+    QString msg = QString("Restored %1 of %2 PVs from %3 in %4 s.")
+      .arg(st.done).arg(st.total).arg(restoreSource)
+      .arg(st.seconds, 0, 'f', 2);
+    if (st.failed == 0) {
+      QMessageBox::information(this, "ADT", msg);
+      return;
+    }
+    msg += QString("\n\n%1 failed:\n").arg(st.failed);
+    const int nshow = 20;
+    for (int i = 0; i < (int)st.failures.size() && i < nshow; ++i)
+      msg += QString::fromStdString(st.failures[i]) + "\n";
+    if ((int)st.failures.size() > nshow)
+      msg += QString("... and %1 more\n").arg(st.failures.size() - nshow);
+    QMessageBox::warning(this, "ADT", msg);
+  }
+
   void readReference()
   {
     if (arrays.isEmpty()) {
@@ -2962,15 +4479,22 @@ private:
     pvFilename = file;
     if (pollTimer)
       pollTimer->stop();
+    if (connectTimer)
+      connectTimer->stop();
+    stopRateTimers();
     timeInterval = 2000;
-
-    if (caStarted) {
-      for (chid ch : channels)
-        ca_clear_channel(ch);
-      channels.clear();
-      ca_context_destroy();
-      caStarted = false;
-    }
+    staleTime = 0.0;
+    coherentWindow = 0.1;
+    temporalWindow = TEMPORAL_WINDOW;
+    envelopeWindow = 0.0;
+    checkStatus = false;
+    checkThreshold = false;
+    if (coherentTimer)
+      coherentTimer->stop();
+
+    acquiring = false;
+    engine.load(std::vector<AcqArraySpec>());
+    stormDrops = 0;
 
     arrays.clear();
     areas.clear();
@@ -2983,23 +4507,21 @@ private:
     for (int i = 0; i < NSAVE; ++i) {
       saveTime[i].clear();
       saveFilename[i].clear();
+      saveStampMin[i] = saveStampMax[i] = 0.0;
     }
     refFilename.clear();
     referenceLoaded = false;
     QString pendingReferenceFile;
 
-    if (ca_context_create(ca_disable_preemptive_callback) != ECA_NORMAL) {
+    if (!engine.start()) {
       QMessageBox::warning(this, "ADT", "Unable to start Channel Access");
       return;
     }
-    caStarted = true;
 
     SDDS_TABLE table;
     QByteArray fname = file.toUtf8();
     if (!SDDS_InitializeInput(&table, fname.data())) {
       QMessageBox::warning(this, "ADT", "Unable to read PV file:\n" + file);
-      ca_context_destroy();
-      caStarted = false;
       return;
     }
 
@@ -3019,8 +4541,6 @@ private:
           QMessageBox::warning(this, "ADT", "Not a valid ADT PV file");
           SDDS_Free(type);
           SDDS_Terminate(&table);
-          ca_context_destroy();
-          caStarted = false;
           return;
         }
         SDDS_Free(type);
@@ -3028,8 +4548,6 @@ private:
             &templong)) {
           QMessageBox::warning(this, "ADT", "Missing ADTNArrays parameter");
           SDDS_Terminate(&table);
-          ca_context_destroy();
-          caStarted = false;
           return;
         }
         narrays = templong;
@@ -3044,6 +4562,20 @@ private:
         if (SDDS_GetParameterAsLong(&table,
             const_cast<char *>("ADTTimeInterval"), &templong))
           timeInterval = static_cast<int>(templong);
+        double stale;
+        if (SDDS_GetParameterAsDouble(&table,
+            const_cast<char *>("ADTStaleTime"), &stale))
+          staleTime = stale > 0.0 ? stale : 0.0;
+        double window;
+        if (SDDS_GetParameterAsDouble(&table,
+            const_cast<char *>("ADTCoherentWindow"), &window) && window > 0.0)
+          coherentWindow = window;
+        if (SDDS_GetParameterAsLong(&table,
+            const_cast<char *>("ADTTemporalWindow"), &templong))
+          temporalWindow = std::min(std::max((int)templong, 2), TEMPORAL_MAX_WINDOW);
+        if (SDDS_GetParameterAsDouble(&table,
+            const_cast<char *>("ADTMaxMinWindow"), &window))
+          envelopeWindow = window > 0.0 ? window : 0.0;
         if (SDDS_GetParameterAsLong(&table,
             const_cast<char *>("ADTZoomInterval"), &templong)) {
           int interval = static_cast<int>(templong);
@@ -3067,6 +4599,9 @@ private:
         if (SDDS_GetParameterAsLong(&table,
             const_cast<char *>("ADTFillMaxMin"), &templong))
           fillmaxmin = templong != 0;
+        if (SDDS_GetParameterAsLong(&table,
+            const_cast<char *>("ADTPercentileBand"), &templong))
+          percentileBand = templong != 0;
         updateViewActions();
         char *latfile = NULL;
         if (SDDS_GetParameter(&table, const_cast<char *>("ADTLatticeFile"),
@@ -3153,6 +4688,14 @@ private:
       else
         arr.zoom = false;
 
+      if (SDDS_GetParameterAsLong(&table,
+          const_cast<char *>("ADTArrayInterval"), &templong) && templong > 0)
+        arr.interval = static_cast<int>(templong);
+      else
+        arr.interval = 0;
+      arr.restore = SDDS_GetParameterAsLong(&table,
+          const_cast<char *>("ADTRestore"), &templong) && templong != 0;
+
       int iarea;
       if (oneAreaPerArray)
         iarea = iarray;
@@ -3195,32 +4738,113 @@ private:
       arr.minVals.fill(LARGEVAL, rows);
       arr.maxVals.fill(-LARGEVAL, rows);
       arr.conn.fill(false, rows);
-      arr.chids.clear();
-      arr.cbData.resize(rows);
+      arr.stamps.fill(0.0, rows);
+      arr.arrivals.fill(0.0, rows);
+      arr.severity.fill(0, rows);
+      arr.stale.fill(false, rows);
+      arr.nstale = 0;
+      arr.staleDue.clear();
+      arr.staleQueued.fill(false, rows);
+      arr.staleRescan = true;
+      arr.validity.fill(0, rows);
+      arr.useMask.clear();
+      arr.markMask.clear();
+      arr.nmarked = 0;
+      arr.touched.fill(0, (rows + 63) / 64);
+      arr.statVals.fill(0.0, rows);
+      arr.statsFull = true;
+      arr.temporal.reset(temporalMode != TEMPORAL_OFF ? rows : 0, temporalWindow,
+                         QDateTime::currentMSecsSinceEpoch() / 1000.0);
+      arr.temporalVals.fill(0.0, rows);
+      resetEnvelope(arr);
+      resetRobust(arr);
+      arr.nconn = 0;
+      arr.frameSeq = 0;
+      arr.drops = 0;
 
       char **names = (char **)SDDS_GetColumn(&table, const_cast<char *>("ControlName"));
       if (!names) {
         QMessageBox::warning(this, "ADT", "PV file missing ControlName column");
         SDDS_Terminate(&table);
-        ca_context_destroy();
-        caStarted = false;
         return;
       }
       for (int i = 0; i < rows; ++i) {
         arr.names.append(names[i]);
-        chid ch;
-        int status = ca_create_channel(names[i], NULL, NULL, 0, &ch);
-        if (status == ECA_NORMAL) {
-          channels.append(ch);
-          arr.chids.append(ch);
-        } else {
-          arr.chids.append(0);
-        }
-        arr.cbData[i].arr = &arr;
-        arr.cbData[i].index = i;
         SDDS_Free(names[i]);
       }
       SDDS_Free(names);
+
+      arr.statusNames.clear();
+      arr.thresholdNames.clear();
+      arr.thresholdLower.clear();
+      arr.thresholdUpper.clear();
+      if (SDDS_CheckColumn(&table, const_cast<char *>("StatusName"), NULL,
+                           SDDS_STRING, NULL) == SDDS_CHECK_OKAY) {
+        char **snames = (char **)SDDS_GetColumn(&table, const_cast<char *>("StatusName"));
+        if (snames) {
+          for (int i = 0; i < rows; ++i) {
+            arr.statusNames.append(snames[i]);
+            SDDS_Free(snames[i]);
+          }
+          SDDS_Free(snames);
+          checkStatus = true;
+        }
+      }
+      if (SDDS_CheckColumn(&table, const_cast<char *>("ThresholdName"), NULL,
+                           SDDS_STRING, NULL) == SDDS_CHECK_OKAY) {
+        double *lower = SDDS_GetColumnInDoubles(&table,
+          const_cast<char *>("ThresholdLowerLimit"));
+        double *upper = SDDS_GetColumnInDoubles(&table,
+          const_cast<char *>("ThresholdUpperLimit"));
+        char **tnames = (char **)SDDS_GetColumn(&table, const_cast<char *>("ThresholdName"));
+        if (!lower || !upper || !tnames) {
+          QMessageBox::warning(this, "ADT",
+            "PV file has ThresholdName but not ThresholdLowerLimit and ThresholdUpperLimit");
+          SDDS_Terminate(&table);
+          return;
+        }
+        for (int i = 0; i < rows; ++i) {
+          arr.thresholdNames.append(tnames[i]);
+          arr.thresholdLower.append(lower[i]);
+          arr.thresholdUpper.append(upper[i]);
+          SDDS_Free(tnames[i]);
+        }
+        SDDS_Free(tnames);
+        SDDS_Free(lower);
+        SDDS_Free(upper);
+        checkThreshold = true;
+      }
+
+      char *protocol = NULL;
+      QString pageProtocol = defaultProtocol;
+      if (SDDS_GetParameter(&table, const_cast<char *>("ADTProtocol"), &protocol) &&
+          protocol) {
+        if (pageProtocol.compare("sim", Qt::CaseInsensitive) != 0)
+          pageProtocol = protocol;
+        SDDS_Free(protocol);
+      }
+      arr.pva = pageProtocol.compare("pva", Qt::CaseInsensitive) == 0;
+      arr.sim = pageProtocol.compare("sim", Qt::CaseInsensitive) == 0;
+
+      char *waveform = NULL;
+      arr.waveform.clear();
+      arr.waveformIndex.clear();
+      if (SDDS_GetParameter(&table, const_cast<char *>("ADTWaveformName"), &waveform) &&
+          waveform) {
+        arr.waveform = waveform;
+        SDDS_Free(waveform);
+      }
+      if (!arr.waveform.isEmpty() &&
+          SDDS_CheckColumn(&table, const_cast<char *>("WaveformIndex"), NULL,
+                           SDDS_ANY_INTEGER_TYPE, NULL) == SDDS_CHECK_OKAY) {
+        int32_t *index = (int32_t *)SDDS_GetColumnInLong(&table,
+          const_cast<char *>("WaveformIndex"));
+        if (index) {
+          for (int i = 0; i < rows; ++i)
+            arr.waveformIndex.append(index[i]);
+          SDDS_Free(index);
+        }
+      }
       if (!latS.isEmpty()) {
         int jstart = 0;
         for (int i = 0; i < rows; ++i) {
@@ -3244,57 +4868,39 @@ private:
 
     SDDS_Terminate(&table);
 
-    if (ca_pend_io(1.0) == ECA_TIMEOUT) {
-      QMessageBox *timeoutBox = new QMessageBox(QMessageBox::Warning, "ADT",
-        "Timeout connecting to PVs.", QMessageBox::NoButton, this);
-      timeoutBox->setAttribute(Qt::WA_DeleteOnClose);
-      timeoutBox->show();
-      QTimer::singleShot(3000, timeoutBox, &QMessageBox::accept);
-    }
-
-    for (ArrayData &arr : arrays) {
-      for (int i = 0; i < arr.nvals; ++i) {
-        if (arr.chids[i] && ca_state(arr.chids[i]) == cs_conn) {
-          ca_array_get(DBR_DOUBLE, 1, arr.chids[i], &arr.vals[i]);
-          arr.conn[i] = true;
-        } else {
-          arr.vals[i] = 0.0;
-          arr.conn[i] = false;
-        }
-      }
+    std::vector<AcqArraySpec> specs(arrays.size());
+    for (int ia = 0; ia < arrays.size(); ++ia) {
+      for (const QString &name : arrays[ia].names)
+        specs[ia].names.push_back(name.toStdString());
+      specs[ia].waveform = arrays[ia].waveform.toStdString();
+      specs[ia].waveformIndex.assign(arrays[ia].waveformIndex.begin(),
+                                     arrays[ia].waveformIndex.end());
+      specs[ia].pva = arrays[ia].pva;
+      specs[ia].sim = arrays[ia].sim;
+      // Search for the top area first so it fills in while the rest connect
+      specs[ia].priority = arrays[ia].area ? arrays[ia].area->index : 0;
+      specs[ia].interval = arrays[ia].interval;
+      for (const QString &name : arrays[ia].statusNames)
+        specs[ia].statusNames.push_back(name.toStdString());
+      for (const QString &name : arrays[ia].thresholdNames)
+        specs[ia].thresholdNames.push_back(name.toStdString());
+      specs[ia].thresholdLower.assign(arrays[ia].thresholdLower.begin(),
+                                      arrays[ia].thresholdLower.end());
+      specs[ia].thresholdUpper.assign(arrays[ia].thresholdUpper.begin(),
+                                      arrays[ia].thresholdUpper.end());
     }
-    ca_pend_io(1.0);
+    if (checkStatusMenu)
+      checkStatusMenu->setEnabled(checkStatus);
+    engine.load(specs);
+    engine.setHeartbeat(staleTime / 2.0);
+    acquiring = true;
 
     for (ArrayData &arr : arrays) {
-      double sum = 0.0;
-      double sumsq = 0.0;
-      double maxv = 0.0;
-      int nconn = 0;
-      bool haveMax = false;
-      for (int i = 0; i < arr.nvals; ++i) {
-        if (!arr.conn[i])
-          continue;
-        double v = arr.vals[i];
-        sum += v;
-        sumsq += v * v;
-        if (!haveMax || std::fabs(v) > std::fabs(maxv)) {
-          maxv = v;
-          haveMax = true;
-        }
-        arr.minVals[i] = v;
-        arr.maxVals[i] = v;
-        ++nconn;
-      }
-      if (nconn > 0) {
-        arr.avg = sum / nconn;
-        arr.sdev = std::sqrt(sumsq / nconn - arr.avg * arr.avg);
-        arr.maxVal = maxv;
-      } else {
-        arr.avg = arr.sdev = arr.maxVal = 0.0;
-      }
+      arr.avg = arr.sdev = arr.maxVal = 0.0;
       arr.runSdev = 0.0;
       arr.runAvg = 0.0;
       arr.runMax = 0.0;
+      arr.runN = 0.0;
     }
 
     nsymbols = latNames.size();
@@ -3383,20 +4989,29 @@ private:
       }
     }
 
-    setWindowTitle("ADT - " + QFileInfo(file).fileName());
+    updateConnectProgress();
     pollTimer->start(timeInterval);
+    startRateTimers();
+    lastConnected = 0;
+    connectIdleTicks = 0;
+    connectTimer->start(100);
   }
 };
 
 static void usage(const char *prog) {
   fprintf(stderr,
-    "Usage: %s [-a directory] [-f pvfile] [-s center_sector] [-z number_of_sectors] [-d] [-x] [-h|-?]\n"
+    "Usage: %s [-a directory] [-f pvfile] [-s center_sector] [-z number_of_sectors] [-d] [-x] [-b batch] [-w ms] [-p protocol] [-r hz] [-h|-?]\n"
     "  -a <directory>          specify ADT home directory\n"
     "  -f <file>               open PV file at startup\n"
     "  -s <center_sector>      set initial zoomed on sector\n"
     "  -z <number_of_sectors>  set initial zoom range\n"
     "  -d                      enable diff mode\n"
     "  -x                      use Xorbit directories\n"
+    "  -b <batch>              channels searched for at once (default 200)\n"
+    "  -w <ms>                 pause between search batches (default 100)\n"
+    "  -p <ca|pva|sim>         protocol of pages without ADTProtocol; sim\n"
+    "                          simulates every page instead\n"
+    "  -r <hz>                 updates per second of simulated PVs (default 10)\n"
     "  -h, -?                  show this help message and exit\n",
     prog);
 }
@@ -3428,6 +5043,14 @@ int main(int argc, char **argv)
       diffMode = true;
     } else if (arg == "-x" || arg == "/x") {
       xorbitMode = true;
+    } else if ((arg == "-b" || arg == "/b") && i + 1 < args.size()) {
+      searchBatch = args.at(++i).toInt();
+    } else if ((arg == "-w" || arg == "/w") && i + 1 < args.size()) {
+      searchInterval = args.at(++i).toInt();
+    } else if ((arg == "-p" || arg == "/p") && i + 1 < args.size()) {
+      defaultProtocol = args.at(++i);
+    } else if ((arg == "-r" || arg == "/r") && i + 1 < args.size()) {
+      simRate = args.at(++i).toDouble();
     } else if (arg == "-h" || arg == "/h" || arg == "-?" || arg == "/?") {
       showHelp = true;
     }
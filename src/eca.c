@@ -53,12 +53,14 @@ static int ecaexit(void);
 static void ecafreearrays(void);
 static void ecagetvals(void);
 static int ecainit(void);
+static chtype ecanativetype(chid id);
 static void ecaprocesscb(XtPointer clientdata, int *source, XtInputId *id);
 static void ecareadbackcb(struct event_handler_args args);
 static void ecaregisterfd(void *dummy, int fd, int opened);
 static void ecastatusreadbackcb(struct event_handler_args args);
 static void ecathresholdreadbackcb(struct event_handler_args args);
 static void ecatimer(XtPointer clientdata, XtIntervalId *id);
+static double ecavalue(struct event_handler_args args);
 
 /* Global variables */
 
@@ -372,6 +374,44 @@ static void ecaprocesscb(XtPointer clientdata, int *source, XtInputId *id)
 {
     ca_poll();
 }
+/**************************** ecanativetype *******************************/
+/* Numeric channels are monitored in their native type, which for status
+   words and ADC counts is much smaller than a double, and widened in the
+   callback.  Anything else is converted to double by the server. */
+static chtype ecanativetype(chid id)
+{
+    short type;
+    
+    type=ca_field_type(id);
+    switch(type) {
+    case DBF_SHORT:
+    case DBF_FLOAT:
+    case DBF_ENUM:
+    case DBF_CHAR:
+    case DBF_LONG:
+	return dbf_type_to_DBR(type);
+    default:
+	return DBR_DOUBLE;
+    }
+}
+/**************************** ecavalue ************************************/
+static double ecavalue(struct event_handler_args args)
+{
+    switch(args.type) {
+    case DBR_SHORT:
+	return *(dbr_short_t *)args.dbr;
+    case DBR_FLOAT:
+	return *(dbr_float_t *)args.dbr;
+    case DBR_ENUM:
+	return *(dbr_enum_t *)args.dbr;
+    case DBR_CHAR:
+	return *(dbr_char_t *)args.dbr;
+    case DBR_LONG:
+	return *(dbr_long_t *)args.dbr;
+    default:
+	return *(dbr_double_t *)args.dbr;
+    }
+}
 /**************************** ecareadbackcb *******************************/
 static void ecareadbackcb(struct event_handler_args args)
 {
@@ -379,7 +419,7 @@ static void ecareadbackcb(struct event_handler_args args)
     double val;
     
 /* Get new value */
-    val=*(double *)args.dbr;
+    val=ecavalue(args);
     curecadata=(struct ECADATA *)args.usr;
     arrays[curecadata->array].vals[curecadata->index]=val;
 }
@@ -681,7 +721,7 @@ int ecastartup(void)
 	if(!ecadata[ineca].ok) continue;
 	ia=ecadata[ineca].array;
 	index=ecadata[ineca].index;
-	status=ca_add_event(DBR_DOUBLE,ecadata[ineca].chid,
+	status=ca_add_event(ecanativetype(ecadata[ineca].chid),ecadata[ineca].chid,
 	  ecareadbackcb,&ecadata[ineca],(evid *)0);
 	if(status != ECA_NORMAL) {
 	    nerrors++;
@@ -710,7 +750,8 @@ int ecastartup(void)
 	    if(!ecadata[ineca].thresholdok) continue;
 	    ia=ecadata[ineca].array;
 	    index=ecadata[ineca].index;
-	    status=ca_add_event(DBR_DOUBLE,ecadata[ineca].thresholdchid,
+	    status=ca_add_event(ecanativetype(ecadata[ineca].thresholdchid),
+	      ecadata[ineca].thresholdchid,
 	      ecathresholdreadbackcb,&ecadata[ineca],(evid *)0);
 	    if(status != ECA_NORMAL) {
 		nerrors++;
@@ -775,7 +816,7 @@ static void ecathresholdreadbackcb(struct event_handler_args args)
     
 
 /* Get new value */
-    val=*(double *)args.dbr;
+    val=ecavalue(args);
     curecadata=(struct ECADATA *)args.usr;
     if ((val >= arrays[curecadata->array].thresholdLL[curecadata->index]) && (val <= arrays[curecadata->array].thresholdUL[curecadata->index]))
       arrays[curecadata->array].thresholdvals[curecadata->index]=1; //Valid
@@ -791,7 +832,8 @@ void ecastoptimer(void)
 /**************************** ecatimer ************************************/
 static void ecatimer(XtPointer clientdata, XtIntervalId *id)
 {
-    int i,ia;
+    int ia;
+    AdtStats st;
     
 /* Poll CA */
     ca_poll();
@@ -799,12 +841,8 @@ static void ecatimer(XtPointer clientdata, XtIntervalId *id)
     statistics();
 /* Determine max and min for history */
     for(ia=0; ia < narrays; ia++) {
-	for(i=0; i < arrays[ia].nvals; i++) {
-	    if(arrays[ia].vals[i] < arrays[ia].minvals[i])
-	      arrays[ia].minvals[i]=arrays[ia].vals[i];
-	    if(arrays[ia].vals[i] > arrays[ia].maxvals[i])
-	      arrays[ia].maxvals[i]=arrays[ia].vals[i];
-	}
+	adtStatsCompute(&st,arrays[ia].vals,NULL,NULL,arrays[ia].nvals,
+	  arrays[ia].minvals,arrays[ia].maxvals);
     }
 /* Redraw graph areas */
     resetgraph();